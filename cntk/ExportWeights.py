@@ -0,0 +1,183 @@
+# Export a trained CNTK model (model2.bin / model3.bin) to the weights file
+# read by the CPU evaluator (src/CpuEvaluator.cpp).
+#
+#   python ExportWeights.py model2.bin model2.weights ol
+#   python ExportWeights.py model3.bin model3.weights p
+#   python ExportWeights.py model.bin model.weights ol,p   (two-headed model)
+#
+# Supported nodes are the ones used by ResNetV*.bs: Convolution (pad=true),
+# BatchNormalization, bias Plus, residual Plus, ReLU, Tanh, Sigmoid, Splice of
+# the inputs and reshapes. The value output "p" is exported as the board
+# "point_value" followed by the komi / tanh head.
+
+import struct
+import sys
+
+import numpy as np
+import cntk as C
+
+NN_INPUT = ['basic', 'features', 'history', 'color', 'komi', 'safety']
+NN_OUTPUT = ['ol', 'p']
+
+OP_CONV, OP_SCALE_SHIFT, OP_RELU, OP_TANH, OP_SIGMOID, OP_ADD, OP_VALUE = range(7)
+
+PASS_THROUGH = ('Reshape', 'Pass', 'NoOp', 'Alias', 'Combine')
+
+
+class Exporter:
+    def __init__(self):
+        self.inputs = []        # (NN_INPUT, channels)
+        self.channels = [0]     # channels of each virtual buffer
+        self.ops = []           # (type, in0, in1, out, ch_in, ch_out, kernel, params)
+        self.buffer = {}        # var uid -> virtual buffer
+
+    def new_buffer(self, channels):
+        self.channels.append(channels)
+        return len(self.channels) - 1
+
+    def convert(self, var, subst):
+        while var.uid in subst:
+            var = subst[var.uid]
+        if var.uid in self.buffer:
+            return self.buffer[var.uid]
+
+        f = var.owner
+        if f is None:
+            raise ValueError('unexpected leaf %s' % var.name)
+
+        if f.is_block:
+            inner = dict(subst)
+            for arg, actual in f.block_arguments_mapping:
+                inner[arg.uid] = actual
+            b = self.convert(f.block_root.outputs[0], inner)
+            self.buffer[var.uid] = b
+            return b
+
+        op = f.op_name
+        args = f.inputs
+        ch = var.shape[0] if len(var.shape) == 3 else 1
+
+        if op == 'Splice':
+            for a in args:
+                if not a.is_input or a.name not in NN_INPUT:
+                    raise ValueError('Splice of %s is not supported' % a.name)
+                self.inputs.append((NN_INPUT.index(a.name), a.shape[0]))
+            self.channels[0] = sum(c for _, c in self.inputs)
+            b = 0
+        elif op in PASS_THROUGH:
+            b = self.convert(args[0], subst)
+        elif op == 'Convolution':
+            w = args[0].value.astype(np.float32)
+            x = self.convert(args[1], subst)
+            b = self.new_buffer(w.shape[0])
+            self.ops.append((OP_CONV, x, 0, b, w.shape[1], w.shape[0], w.shape[2], [w]))
+        elif op == 'BatchNormalization':
+            x = self.convert(args[0], subst)
+            scale, bias, mean, var_ = [a.value.astype(np.float64).reshape(-1) for a in args[1:5]]
+            eps = f.attributes.get('epsilon', 1e-5)
+            a = scale / np.sqrt(var_ + eps)
+            b_ = bias - mean * a
+            b = self.new_buffer(ch)
+            self.ops.append((OP_SCALE_SHIFT, x, 0, b, ch, ch, 0, [a.astype(np.float32), b_.astype(np.float32)]))
+        elif op == 'Plus':
+            consts = [a for a in args if a.is_parameter or a.is_constant]
+            if consts:
+                other = [a for a in args if not (a.is_parameter or a.is_constant)][0]
+                x = self.convert(other, subst)
+                shift = consts[0].value.astype(np.float32).reshape(-1)
+                b = self.new_buffer(ch)
+                self.ops.append((OP_SCALE_SHIFT, x, 0, b, ch, ch, 0, [np.ones_like(shift), shift]))
+            else:
+                x0 = self.convert(args[0], subst)
+                x1 = self.convert(args[1], subst)
+                b = self.new_buffer(ch)
+                self.ops.append((OP_ADD, x0, x1, b, ch, ch, 0, []))
+        elif op in ('ReLU', 'Tanh', 'Sigmoid', 'StableSigmoid'):
+            t = {'ReLU': OP_RELU, 'Tanh': OP_TANH}.get(op, OP_SIGMOID)
+            x = self.convert(args[0], subst)
+            b = self.new_buffer(ch)
+            self.ops.append((t, x, 0, b, ch, ch, 0, []))
+        else:
+            raise ValueError('%s is not supported' % op)
+
+        self.buffer[var.uid] = b
+        return b
+
+    def allocate(self, outputs):
+        # reuse buffers which are no longer referenced
+        last = {}
+        for i, o in enumerate(self.ops):
+            last[o[1]] = i
+            if o[0] == OP_ADD:
+                last[o[2]] = i
+        for output in outputs:
+            last[output] = len(self.ops)
+
+        physical = {0: 0}
+        channels = [self.channels[0]]
+        free = []
+        ops = []
+        for i, o in enumerate(self.ops):
+            t, in0, in1, out, ch_in, ch_out, k, params = o
+            c = self.channels[out]
+            slot = next((s for s in free if channels[s] == c), None)
+            if slot is None:
+                channels.append(c)
+                slot = len(channels) - 1
+            else:
+                free.remove(slot)
+            physical[out] = slot
+            ops.append((t, physical[in0], physical[in1] if t == OP_ADD else 0, slot, ch_in, ch_out, k, params))
+            for v in set([in0, in1] if t == OP_ADD else [in0]):
+                if v != 0 and last.get(v) == i:
+                    free.append(physical[v])
+        return ops, channels, [physical[o] for o in outputs]
+
+
+def main():
+    if len(sys.argv) != 4:
+        print('usage: ExportWeights.py model.bin model.weights (ol|p|ol,p)')
+        sys.exit(1)
+
+    model = C.load_model(sys.argv[1])
+    names = sys.argv[3].split(',')
+    ex = Exporter()
+
+    outs = []
+    for name in names:
+        if name not in NN_OUTPUT:
+            raise ValueError('unknown output %s' % name)
+        if name == 'p':
+            out = ex.convert(model.find_by_name('point_value').outputs[0], {})
+            params = dict((p.name, float(p.value.reshape(-1)[0])) for p in model.parameters)
+            value = ex.new_buffer(0)
+            ex.ops.append((OP_VALUE, out, 0, value, 1, 0, 0,
+                           [np.array([params['komi_scale'], params['sum_scale']], dtype=np.float32)]))
+            out = value
+        else:
+            out = ex.convert(model.find_by_name(name).outputs[0], {})
+        outs.append(out)
+
+    ops, channels, outputs = ex.allocate(outs)
+
+    with open(sys.argv[2], 'wb') as fp:
+        fp.write(struct.pack('<4si', b'RYNN', 2))
+        fp.write(struct.pack('<i', len(ex.inputs)))
+        for i, c in ex.inputs:
+            fp.write(struct.pack('<ii', i, c))
+        fp.write(struct.pack('<i', len(channels)))
+        fp.write(struct.pack('<%di' % len(channels), *channels))
+        fp.write(struct.pack('<i', len(outputs)))
+        for name, o in zip(names, outputs):
+            fp.write(struct.pack('<ii', NN_OUTPUT.index(name), o))
+        fp.write(struct.pack('<i', len(ops)))
+        for t, in0, in1, o, ch_in, ch_out, k, params in ops:
+            fp.write(struct.pack('<7i', t, in0, in1, o, ch_in, ch_out, k))
+            for p in params:
+                fp.write(np.ascontiguousarray(p, dtype='<f4').tobytes())
+
+    print('%d ops, %d buffers' % (len(ops), len(channels)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "BatchControl.h"
+
+using namespace std;
+
+
+////////////
+//  定数  //
+////////////
+
+// 古い計測の重みの減衰率
+const double LATENCY_DECAY = 0.95;
+
+// 最適な局面/秒に対してこの割合を満たす最小のバッチサイズを使う
+const double THROUGHPUT_RATE = 0.95;
+
+// 1回の評価の目標時間の範囲(秒)
+const double LATENCY_TARGET_MIN = 0.005;
+const double LATENCY_TARGET_MAX = 0.2;
+
+
+BatchControl::BatchControl( const string &name, int initial_batch_size )
+  : name(name), batch_size(initial_batch_size), flush_timeout(0),
+    max_batch_size(initial_batch_size), latency_target(LATENCY_TARGET_MAX)
+{
+  Clear();
+}
+
+
+////////////////////////////
+//  バッチサイズの上限    //
+////////////////////////////
+void
+BatchControl::SetMaxBatchSize( int size )
+{
+  lock_guard<mutex> lock(mutex_stat);
+  max_batch_size = max(1, size);
+  batch_size = min((int)batch_size, max_batch_size);
+  Update();
+}
+
+
+//////////////////////////
+//  目標の遅延の設定    //
+//////////////////////////
+void
+BatchControl::SetLatencyTarget( double sec )
+{
+  lock_guard<mutex> lock(mutex_stat);
+  latency_target = sec;
+  Update();
+}
+
+
+//////////////////////
+//  統計のクリア    //
+//////////////////////
+void
+BatchControl::Clear()
+{
+  lock_guard<mutex> lock(mutex_stat);
+  sum_w = sum_n = sum_nn = sum_t = sum_nt = 0;
+  latency_fixed = latency_per_position = 0;
+  total_batches = total_positions = 0;
+  total_time = 0;
+  batch_size = max_batch_size;
+  flush_timeout = 0;
+}
+
+
+//////////////////////
+//  評価時間の記録  //
+//////////////////////
+void
+BatchControl::Record( int size, double sec )
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  sum_w = sum_w * LATENCY_DECAY + 1;
+  sum_n = sum_n * LATENCY_DECAY + size;
+  sum_nn = sum_nn * LATENCY_DECAY + (double)size * size;
+  sum_t = sum_t * LATENCY_DECAY + sec;
+  sum_nt = sum_nt * LATENCY_DECAY + size * sec;
+
+  total_batches++;
+  total_positions += size;
+  total_time += sec;
+
+  Update();
+}
+
+
+////////////////////////////////
+//  バッチサイズと待ち時間の  //
+//  更新                      //
+////////////////////////////////
+void
+BatchControl::Update()
+{
+  if (sum_w < 4)
+    return;
+
+  const double mean_n = sum_n / sum_w;
+  const double mean_t = sum_t / sum_w;
+  const double var_n = sum_nn / sum_w - mean_n * mean_n;
+
+  if (var_n < 0.25) {
+    // 同じバッチサイズばかりで傾きが分からないので, 余裕があれば大きくしてみる
+    if (mean_t < latency_target * 0.5)
+      batch_size = min(max_batch_size, max(2, (int)batch_size * 2));
+    return;
+  }
+
+  const double cov = sum_nt / sum_w - mean_n * mean_t;
+  latency_per_position = max(1e-6, cov / var_n);
+  latency_fixed = max(0.0, mean_t - latency_per_position * mean_n);
+
+  // 目標の遅延に収まる最大のバッチサイズ
+  const double feasible = min((double)max_batch_size, max(1.0, (latency_target - latency_fixed) / latency_per_position));
+  const double best = feasible / (latency_fixed + latency_per_position * feasible);
+
+  // best * THROUGHPUT_RATE <= n / (latency_fixed + latency_per_position * n) を満たす最小のn
+  const double rate = best * THROUGHPUT_RATE;
+  const double n = rate * latency_fixed / (1 - rate * latency_per_position);
+
+  batch_size = (int)min(feasible, max(1.0, ceil(n)));
+
+  // 待ち時間は固定の評価時間を超えないようにする
+  flush_timeout = min(latency_fixed, latency_target * 0.5);
+}
+
+
+//////////////////
+//  状態の出力  //
+//////////////////
+void
+BatchControl::Print( ostream &out ) const
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  out << name << " : batch " << batch_size << "/" << max_batch_size;
+  out << std::fixed << setprecision(2);
+  out << ", timeout " << flush_timeout * 1000 << " ms";
+  out << ", latency " << latency_fixed * 1000 << " + " << latency_per_position * 1000 << " * n ms";
+  out << " (target " << latency_target * 1000 << " ms)";
+  out << setprecision(1);
+  out << ", " << (total_time > 0 ? total_positions / total_time : 0.0) << " pos/s";
+  out << ", " << total_batches << " batches";
+  out << ", avg batch " << (total_batches > 0 ? (double)total_positions / total_batches : 0.0);
+  out << endl;
+}
+
+
+////////////////////////////////
+//  1回の評価の目標時間       //
+////////////////////////////////
+double
+BatchLatencyTarget( double time_limit )
+{
+  return min(LATENCY_TARGET_MAX, max(LATENCY_TARGET_MIN, time_limit * 0.02));
+}
@@ -0,0 +1,72 @@
+#ifndef _BATCHCONTROL_H_
+#define _BATCHCONTROL_H_
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+
+//////////////
+//  クラス  //
+//////////////
+
+// NN評価のバッチサイズの制御
+// 評価にかかった時間を latency = a + b * batch で近似し,
+// 目標の遅延に収まる範囲で局面/秒がほぼ最大になるバッチサイズと,
+// バッチが埋まるまで待つ時間を決める
+class BatchControl {
+public:
+  BatchControl( const std::string &name, int initial_batch_size );
+
+  //  バッチサイズの上限
+  void SetMaxBatchSize( int size );
+  int GetMaxBatchSize() const { return max_batch_size; }
+
+  //  1回の評価にかけてよい時間(秒)
+  void SetLatencyTarget( double sec );
+
+  //  現在のバッチサイズ
+  int BatchSize() const { return batch_size; }
+
+  //  バッチが埋まるのを待つ時間(秒)
+  double FlushTimeout() const { return flush_timeout; }
+
+  //  評価にかかった時間を記録してバッチサイズを更新
+  void Record( int size, double sec );
+
+  //  統計のクリア
+  void Clear();
+
+  //  状態の出力
+  void Print( std::ostream &out ) const;
+
+private:
+  void Update();
+
+  std::string name;
+  std::atomic<int> batch_size;
+  std::atomic<double> flush_timeout;
+  int max_batch_size;
+  double latency_target;
+
+  // 指数移動の重み付き最小二乗の和
+  double sum_w, sum_n, sum_nn, sum_t, sum_nt;
+  // latency = fixed + per_position * batch
+  double latency_fixed, latency_per_position;
+
+  long long total_batches, total_positions;
+  double total_time;
+
+  mutable std::mutex mutex_stat;
+};
+
+
+////////////
+//  関数  //
+////////////
+
+//  1回の評価の目標時間を探索時間から決める
+double BatchLatencyTarget( double time_limit );
+
+#endif
@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <iostream>
+#include <unordered_map>
+
+#include "Evaluator.h"
+
+#if !defined (NO_CNTK)
+#include "CNTKLibrary.h"
+#endif
+
+using namespace std;
+
+#if !defined (NO_CNTK)
+
+//////////////////////
+//  CNTKの評価器    //
+//////////////////////
+class CntkEvaluator : public Evaluator {
+public:
+  CntkEvaluator( CNTK::FunctionPtr f, const CNTK::DeviceDescriptor& dev,
+		 const vector<NN_INPUT>& inputs, const vector<NN_OUTPUT>& outputs );
+
+protected:
+  void Reallocated();
+  void Run( int num_req );
+
+private:
+  CNTK::FunctionPtr func;
+  CNTK::DeviceDescriptor device;
+  vector<NN_INPUT> input_id;
+  vector<CNTK::Variable> var_input;
+  vector<NN_OUTPUT> output_id;
+  vector<CNTK::Variable> var_output;
+  // バッチサイズ毎の入出力
+  vector<unordered_map<CNTK::Variable, CNTK::ValuePtr>> inputs;
+  vector<vector<CNTK::NDArrayViewPtr>> outputs;
+};
+
+// 出力の変数名
+const wstring nn_output_name[NN_OUTPUT_MAX] = {
+  L"ol",
+  L"p",
+};
+
+
+static CNTK::DeviceDescriptor
+GetDevice( int device_id )
+{
+  if (device_id == -1)
+    return CNTK::DeviceDescriptor::CPUDevice();
+  if (device_id == -2)
+    return CNTK::DeviceDescriptor::UseDefaultDevice();
+  return CNTK::DeviceDescriptor::GPUDevice(device_id);
+}
+
+
+static bool
+GetVariableByName(vector<CNTK::Variable> variableLists, wstring varName, CNTK::Variable& var)
+{
+  for (vector<CNTK::Variable>::iterator it = variableLists.begin(); it != variableLists.end(); ++it)
+  {
+    if (it->Name().compare(varName) == 0)
+    {
+      var = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline bool
+GetInputVariableByName(CNTK::FunctionPtr evalFunc, wstring varName, CNTK::Variable& var)
+{
+  return GetVariableByName(evalFunc->Arguments(), varName, var);
+}
+
+static inline bool
+GetOutputVaraiableByName(CNTK::FunctionPtr evalFunc, wstring varName, CNTK::Variable& var)
+{
+  return GetVariableByName(evalFunc->Outputs(), varName, var);
+}
+
+
+CntkEvaluator::CntkEvaluator( CNTK::FunctionPtr f, const CNTK::DeviceDescriptor& dev,
+			      const vector<NN_INPUT>& inputs, const vector<NN_OUTPUT>& outputs )
+  : func(f), device(dev), input_id(inputs), output_id(outputs)
+{
+  var_input.resize(input_id.size());
+  for (size_t i = 0; i < input_id.size(); i++) {
+    if (!GetInputVariableByName(func, nn_input_name[input_id[i]], var_input[i])) {
+      wcerr << L"Input variable " << nn_input_name[input_id[i]] << L" not found" << endl;
+      abort();
+    }
+    SetInputSize(input_id[i], var_input[i].Shape().TotalSize());
+  }
+  var_output.resize(output_id.size());
+  for (size_t i = 0; i < output_id.size(); i++) {
+    if (!GetOutputVaraiableByName(func, nn_output_name[output_id[i]], var_output[i])) {
+      wcerr << L"Output variable " << nn_output_name[output_id[i]] << L" not found" << endl;
+      abort();
+    }
+    SetOutputSize(output_id[i], var_output[i].Shape().TotalSize());
+  }
+}
+
+
+void
+CntkEvaluator::Reallocated()
+{
+  // バッファを確保し直すとViewが無効になるので作り直す
+  inputs.clear();
+  inputs.resize(capacity + 1);
+  outputs.clear();
+  outputs.resize(capacity + 1);
+}
+
+
+void
+CntkEvaluator::Run( int num_req )
+{
+  auto& input = inputs[num_req];
+  if (input.empty()) {
+    const size_t n = num_req;
+    for (size_t i = 0; i < var_input.size(); i++) {
+      const NN_INPUT id = input_id[i];
+      CNTK::NDShape shape = var_input[i].Shape().AppendShape({ 1, n });
+      auto view = CNTK::MakeSharedObject<CNTK::NDArrayView>(shape, input_data[id].data(), n * input_size[id], CNTK::DeviceDescriptor::CPUDevice(), true);
+      input[var_input[i]] = CNTK::MakeSharedObject<CNTK::Value>(view);
+    }
+    for (size_t i = 0; i < var_output.size(); i++) {
+      const NN_OUTPUT id = output_id[i];
+      CNTK::NDShape shape = var_output[i].Shape().AppendShape({ 1, n });
+      outputs[num_req].push_back(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape, output_data[id].data(), n * output_size[id], CNTK::DeviceDescriptor::CPUDevice(), false));
+    }
+  }
+
+  unordered_map<CNTK::Variable, CNTK::ValuePtr> output;
+  for (const auto& var : var_output) {
+    output[var] = nullptr;
+  }
+
+  try {
+    func->Forward(input, output, device);
+  } catch (const std::exception& err) {
+    fprintf(stderr, "Evaluation failed. EXCEPTION occurred: %s\n", err.what());
+    abort();
+  } catch (...) {
+    fprintf(stderr, "Evaluation failed. Unknown ERROR occurred.\n");
+    abort();
+  }
+
+  for (size_t i = 0; i < var_output.size(); i++) {
+    outputs[num_req][i]->CopyFrom(*output[var_output[i]]->Data());
+  }
+}
+
+
+unique_ptr<Evaluator>
+CreateCntkEvaluator( NN_MODEL model, const string &path, int device_id )
+{
+  wchar_t name[1024];
+  mbstate_t ps;
+  memset(&ps, 0, sizeof(ps));
+  const char * src = path.c_str();
+  mbsrtowcs(name, &src, 1024, &ps);
+  wstring model_name = name;
+
+  auto device = GetDevice(device_id);
+
+  for (char c : "/" + ModelFileName(NN_BACKEND_CNTK, model)) {
+    model_name += (wchar_t)c;
+  }
+
+  CNTK::FunctionPtr func = CNTK::Function::Load(model_name, device);
+
+  if (!func) {
+    cerr << "Get EvalModel failed\n";
+    abort();
+  }
+
+#if 0
+  for (auto var : func->Inputs()) {
+    wcerr << var.AsString() << endl;
+  }
+  for (auto var : func->Outputs()) {
+    wcerr << var.AsString() << endl;
+  }
+#endif
+
+  switch (model) {
+    case NN_MODEL_POLICY:
+      return unique_ptr<Evaluator>(new CntkEvaluator(func, device, { NN_BASIC, NN_FEATURES, NN_HISTORY }, { NN_OUTPUT_POLICY }));
+    case NN_MODEL_VALUE:
+      return unique_ptr<Evaluator>(new CntkEvaluator(func, device, { NN_BASIC, NN_FEATURES, NN_HISTORY, NN_COLOR, NN_KOMI, NN_SAFETY }, { NN_OUTPUT_VALUE }));
+    default:
+      return unique_ptr<Evaluator>(new CntkEvaluator(func, device, { NN_BASIC, NN_FEATURES, NN_HISTORY, NN_COLOR, NN_KOMI, NN_SAFETY }, { NN_OUTPUT_POLICY, NN_OUTPUT_VALUE }));
+  }
+}
+
+#else
+
+unique_ptr<Evaluator>
+CreateCntkEvaluator( NN_MODEL model, const string &path, int device_id )
+{
+  cerr << "This binary is built without CNTK. Use --nn-backend cpu" << endl;
+  exit(1);
+}
+
+#endif
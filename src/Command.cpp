@@ -5,9 +5,12 @@
 
 #include "Command.h"
 #include "DynamicKomi.h"
+#include "EvalStat.h"
+#include "Evaluator.h"
 #include "GoBoard.h"
 #include "Gtp.h"
 #include "Message.h"
+#include "Simulation.h"
 #include "UctSearch.h"
 #include "ZobristHash.h"
 
@@ -39,6 +42,13 @@ const string command[COMMAND_MAX] = {
   "--no-expand",
   "--device-id",
   "--verbose",
+  "--nn-backend",
+  "--nn-precision",
+  "--nn-calibration",
+  "--symmetry-depth",
+  "--no-random-symmetry",
+  "--eval-trace",
+  "--mercy-threshold",
 };
 
 //  コマンドの説明
@@ -62,6 +72,13 @@ const string errmessage[COMMAND_MAX] = {
   "No MCTS",
   "Set GPU to use",
   "Verbose log mode",
+  "Set NN backend (cntk or cpu)",
+  "Set precision of CPU backend (fp32, fp16 or int8)",
+  "Set positions to calibrate int8 (dumped by _dump)",
+  "Set depth to evaluate all 8 symmetries (1 = root, 0 = none)",
+  "Evaluate NN without random symmetry",
+  "Write timestamps of NN requests (csv, or json lines if *.json)",
+  "Stop playouts when the stone difference reaches this (0 = never)",
 };
 
 
@@ -161,6 +178,45 @@ AnalyzeCommand( int argc, char **argv )
       case COMMAND_VERBOSE:
         SetVerbose(true);
         break;
+      case COMMAND_NN_BACKEND:
+        i++;
+        if (!strcmp(argv[i], "cntk")) {
+          SetNNBackend(NN_BACKEND_CNTK);
+        } else if (!strcmp(argv[i], "cpu")) {
+          SetNNBackend(NN_BACKEND_CPU);
+        } else {
+          fprintf(stderr, "Unknown NN backend : %s\n", argv[i]);
+          exit(1);
+        }
+        break;
+      case COMMAND_NN_PRECISION:
+        i++;
+        if (!strcmp(argv[i], "fp32")) {
+          SetCpuPrecision(NN_PRECISION_FP32);
+        } else if (!strcmp(argv[i], "fp16")) {
+          SetCpuPrecision(NN_PRECISION_FP16);
+        } else if (!strcmp(argv[i], "int8")) {
+          SetCpuPrecision(NN_PRECISION_INT8);
+        } else {
+          fprintf(stderr, "Unknown NN precision : %s\n", argv[i]);
+          exit(1);
+        }
+        break;
+      case COMMAND_NN_CALIBRATION:
+        SetCpuCalibration(argv[++i]);
+        break;
+      case COMMAND_SYMMETRY_DEPTH:
+        SetSymmetryDepth(atoi(argv[++i]));
+        break;
+      case COMMAND_NO_RANDOM_SYMMETRY:
+        SetRandomSymmetry(false);
+        break;
+      case COMMAND_EVAL_TRACE:
+        SetEvalTraceFile(argv[++i]);
+        break;
+      case COMMAND_MERCY_THRESHOLD:
+        SetMercyThreshold(atoi(argv[++i]));
+        break;
       default:
 	for (int j = 0; j < COMMAND_MAX; j++){
 	  fprintf(stderr, "%-22s : %s\n", command[j].c_str(), errmessage[j].c_str());
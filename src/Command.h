@@ -24,6 +24,13 @@ enum COMMAND {
   COMMAND_NO_EXPAND,
   COMMAND_DEVICE_ID,
   COMMAND_VERBOSE,
+  COMMAND_NN_BACKEND,
+  COMMAND_NN_PRECISION,
+  COMMAND_NN_CALIBRATION,
+  COMMAND_SYMMETRY_DEPTH,
+  COMMAND_NO_RANDOM_SYMMETRY,
+  COMMAND_EVAL_TRACE,
+  COMMAND_MERCY_THRESHOLD,
   COMMAND_MAX,
 };
 
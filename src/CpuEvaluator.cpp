@@ -0,0 +1,1109 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined (__SSE2__) || defined (_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "Evaluator.h"
+#include "GoBoard.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////
+//  CPUの評価器                                                //
+//                                                            //
+//  cntk/ExportWeights.py で書き出した重みファイルを読み込み,  //
+//  cntk/ResNetV*.bs の残差ネットワークをCPUだけで計算する     //
+//                                                            //
+//  重みファイル (リトルエンディアン)                          //
+//    char  magic[4] = "RYNN"                                 //
+//    int32 version                                           //
+//    int32 入力の数, (int32 NN_INPUT, int32 チャンネル数)...  //
+//      入力は順にバッファ0へ連結される                        //
+//    int32 バッファの数, int32 チャンネル数... (0はスカラ)    //
+//    int32 出力の数, (int32 NN_OUTPUT, int32 バッファ)...     //
+//      (version 1 は int32 バッファのみで, モデルで決まる)   //
+//    int32 演算の数, 演算...                                 //
+//      int32 type, in0, in1, out, ch_in, ch_out, kernel      //
+//      float パラメータ...                                   //
+//                                                            //
+//  INT8 : 畳み込みの重みを出力チャンネル毎, 入力をテンソル毎  //
+//         に量子化する. 入力が非負の畳み込みだけが対象で,     //
+//         入力は7bit (0〜127) にして積和の飽和を避ける        //
+//  FP16 : 畳み込みの重みを半精度で保持し, 行列積でaの行を     //
+//         並べる時にfloatにする                               //
+////////////////////////////////////////////////////////////////
+
+const char nn_weights_magic[4] = { 'R', 'Y', 'N', 'N' };
+const int nn_weights_version = 2;
+
+// 演算の種類
+enum NN_OP {
+  NN_OP_CONV,		// 畳み込み (バイアスなし)
+  NN_OP_SCALE_SHIFT,	// チャンネル毎の ax+b (BatchNormalization, バイアス)
+  NN_OP_RELU,
+  NN_OP_TANH,
+  NN_OP_SIGMOID,
+  NN_OP_ADD,		// 残差の足し算
+  NN_OP_VALUE,		// 盤面の和とコミから勝率 (-1〜1)
+  NN_OP_MAX,
+};
+
+struct nn_op_t {
+  int type;
+  int in0, in1, out;
+  int ch_in, ch_out;
+  int kernel;
+  vector<float> weight;
+  vector<float> bias;
+  // FP16
+  vector<uint16_t> weight_half;
+  // INT8
+  bool quantized;
+  int k_pad;			// 4の倍数に切り上げた入力の長さ
+  vector<int8_t> weight_q;	// [ch_out][k_pad]
+  vector<float> weight_scale;	// 出力チャンネル毎
+  float input_scale;		// 入力のスケール (0なら評価毎に決める)
+};
+
+// 計算の精度
+static NN_PRECISION cpu_precision = NN_PRECISION_FP32;
+
+// INT8のキャリブレーションに使う局面
+static string cpu_calibration;
+
+// キャリブレーションに使う局面の最大数
+const int CALIBRATION_MAX = 1000;
+
+// 1回の行列積にまとめる局面の最大数 (バッファの大きさを抑える)
+const int CPU_BATCH_MAX = 8;
+
+// 行列積のブロックの大きさ (cの行数, 列数, aの列数, bの列数)
+const int GEMM_MR = 6;
+#if defined (__AVX512F__)
+const int GEMM_NR = 32;
+#else
+const int GEMM_NR = 16;
+#endif
+const int GEMM_KC = 128;
+const int GEMM_NC = 1024;
+
+
+class CpuEvaluator : public Evaluator {
+public:
+  CpuEvaluator( NN_MODEL model, const string &filename );
+
+protected:
+  void Reallocated( void );
+  void Run( int num_req );
+
+private:
+  void RunBatch( int first, int num );
+  void Quantize( void );
+  void Calibrate( const string &filename );
+  template <typename T>
+  void Convolution( const nn_op_t &op, const T *weight, const float *in, float *out, int num );
+  void ConvolutionInt8( const nn_op_t &op, const float *in, float *out, int num );
+  // num局面分のバッファの列数
+  int Columns( int num ) const { return (num * plane + GEMM_NR - 1) & ~(GEMM_NR - 1); }
+
+  NN_PRECISION precision;
+  int plane;
+  int width;
+  // 評価中の局面のバッファの列数
+  int columns;
+  vector<NN_INPUT> input_id;
+  vector<int> input_channels;
+  vector<int> buffer_channels;
+  vector<vector<float>> buffer;
+  vector<float> col;
+  vector<float> col_row;
+  vector<uint8_t> input_q;
+  vector<uint8_t> col_q;
+  vector<uint8_t> col_q_rows;
+  vector<int32_t> acc;
+  // INT8の畳み込みのチャンネル数と入力の長さの最大値
+  int quant_channels;
+  int quant_k_pad;
+  vector<NN_OUTPUT> output_id;
+  vector<int> output_buffer;
+  vector<nn_op_t> ops;
+  // キャリブレーション中の畳み込みの入力の最大値
+  vector<float> *input_max;
+};
+
+
+//////////////////
+//  精度の設定  //
+//////////////////
+void
+SetCpuPrecision( NN_PRECISION precision )
+{
+  cpu_precision = precision;
+}
+
+void
+SetCpuCalibration( const string &filename )
+{
+  cpu_calibration = filename;
+}
+
+
+////////////////////
+//  半精度の変換  //
+////////////////////
+static uint16_t
+FloatToHalf( float f )
+{
+#if defined (__F16C__)
+  return _cvtss_sh(f, 0);
+#else
+  uint32_t x;
+  memcpy(&x, &f, 4);
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const int exp = (int)((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+
+  if (exp <= 0) {
+    // 非正規化数 (小さすぎるものは0)
+    if (exp < -10) return (uint16_t)sign;
+    mant |= 0x800000;
+    const int shift = 14 - exp;
+    uint32_t h = mant >> shift;
+    if ((mant >> (shift - 1)) & 1) h++;
+    return (uint16_t)(sign | h);
+  } else if (exp >= 31) {
+    return (uint16_t)(sign | 0x7c00);
+  }
+  uint32_t h = sign | (exp << 10) | (mant >> 13);
+  if (mant & 0x1000) h++;
+  return (uint16_t)h;
+#endif
+}
+
+static float
+HalfToFloat( uint16_t h )
+{
+#if defined (__F16C__)
+  return _cvtsh_ss(h);
+#else
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  int exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+
+  if (exp == 0) {
+    if (mant == 0) {
+      x = sign;
+    } else {
+      // 非正規化数
+      exp = 1;
+      while ((mant & 0x400) == 0) {
+	mant <<= 1;
+	exp--;
+      }
+      mant &= 0x3ff;
+      x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, 4);
+  return f;
+#endif
+}
+
+
+// 重みの行をfloatで読む (半精度はdstに変換する)
+static const float *
+WidenWeights( const float *src, float *, int )
+{
+  return src;
+}
+
+static const float *
+WidenWeights( const uint16_t *src, float *dst, int size )
+{
+  int i = 0;
+#if defined (__F16C__)
+  for (; i + 8 <= size; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+  }
+#endif
+  for (; i < size; i++) {
+    dst[i] = HalfToFloat(src[i]);
+  }
+  return dst;
+}
+
+
+////////////////////////
+//  ファイルの読み込み  //
+////////////////////////
+static void
+ReadInts( FILE *fp, const string &filename, int *ap, size_t size )
+{
+  if (fread(ap, sizeof(int), size, fp) != size) {
+    cerr << "Read Error : " << filename << endl;
+    exit(1);
+  }
+}
+
+static int
+ReadInt( FILE *fp, const string &filename )
+{
+  int value;
+  ReadInts(fp, filename, &value, 1);
+  return value;
+}
+
+static void
+ReadFloats( FILE *fp, const string &filename, vector<float> &ap, size_t size )
+{
+  ap.resize(size);
+  if (fread(ap.data(), sizeof(float), size, fp) != size) {
+    cerr << "Read Error : " << filename << endl;
+    exit(1);
+  }
+}
+
+
+CpuEvaluator::CpuEvaluator( NN_MODEL model, const string &filename )
+  : precision(NN_PRECISION_FP32), plane(pure_board_max), width(pure_board_size),
+    columns(0), quant_channels(0), quant_k_pad(0), input_max(nullptr)
+{
+  FILE *fp;
+#if defined (_WIN32)
+  if (fopen_s(&fp, filename.c_str(), "rb") != 0) {
+    fp = NULL;
+  }
+#else
+  fp = fopen(filename.c_str(), "rb");
+#endif
+  if (fp == NULL) {
+    cerr << "can not open -" << filename << "-" << endl;
+    exit(1);
+  }
+
+  char magic[4];
+  int version = 0;
+  if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, nn_weights_magic, 4) != 0 ||
+      (version = ReadInt(fp, filename)) < 1 || version > nn_weights_version) {
+    cerr << "Unknown weights format : " << filename << endl;
+    exit(1);
+  }
+
+  // 入力
+  const int num_inputs = ReadInt(fp, filename);
+  int channels = 0;
+  for (int i = 0; i < num_inputs; i++) {
+    const int id = ReadInt(fp, filename);
+    const int ch = ReadInt(fp, filename);
+    if (id < 0 || id >= NN_INPUT_MAX || ch <= 0) {
+      cerr << "Invalid input : " << filename << endl;
+      exit(1);
+    }
+    input_id.push_back((NN_INPUT)id);
+    input_channels.push_back(ch);
+    SetInputSize((NN_INPUT)id, ch * plane);
+    channels += ch;
+  }
+
+  // バッファ
+  buffer_channels.resize(ReadInt(fp, filename));
+  ReadInts(fp, filename, buffer_channels.data(), buffer_channels.size());
+  if (buffer_channels.empty() || buffer_channels[0] != channels ||
+      *min_element(buffer_channels.begin(), buffer_channels.end()) < 0) {
+    cerr << "Invalid buffers : " << filename << endl;
+    exit(1);
+  }
+
+  // 出力
+  if (version == 1) {
+    output_id.push_back(model == NN_MODEL_POLICY ? NN_OUTPUT_POLICY : NN_OUTPUT_VALUE);
+    output_buffer.push_back(ReadInt(fp, filename));
+  } else {
+    const int num_outputs = ReadInt(fp, filename);
+    for (int i = 0; i < num_outputs; i++) {
+      const int id = ReadInt(fp, filename);
+      output_id.push_back((NN_OUTPUT)(id >= 0 && id < NN_OUTPUT_MAX ? id : NN_OUTPUT_MAX));
+      output_buffer.push_back(ReadInt(fp, filename));
+    }
+  }
+  for (size_t i = 0; i < output_id.size(); i++) {
+    if (output_id[i] == NN_OUTPUT_MAX ||
+	output_buffer[i] < 0 || output_buffer[i] >= (int)buffer_channels.size()) {
+      cerr << "Invalid output : " << filename << endl;
+      exit(1);
+    }
+  }
+  buffer.resize(buffer_channels.size());
+
+  // 演算
+  ops.resize(ReadInt(fp, filename));
+  for (nn_op_t &op : ops) {
+    int header[7];
+    ReadInts(fp, filename, header, 7);
+    op.type = header[0];
+    op.in0 = header[1];
+    op.in1 = header[2];
+    op.out = header[3];
+    op.ch_in = header[4];
+    op.ch_out = header[5];
+    op.kernel = header[6];
+
+    const int num_buffers = buffer.size();
+    if (op.type < 0 || op.type >= NN_OP_MAX ||
+	op.in0 < 0 || op.in0 >= num_buffers ||
+	op.out < 0 || op.out >= num_buffers ||
+	(op.type == NN_OP_ADD && (op.in1 < 0 || op.in1 >= num_buffers))) {
+      cerr << "Invalid operation : " << filename << endl;
+      exit(1);
+    }
+
+    // チャンネル数とカーネルの大きさがバッファに収まるか
+    // (畳み込み以外は出力にもch_in分を書き込む)
+    bool valid = op.ch_in > 0 && op.ch_out >= 0 &&
+      op.ch_in <= buffer_channels[op.in0] &&
+      op.ch_out <= buffer_channels[op.out];
+    if (op.type == NN_OP_CONV) {
+      valid = valid && op.ch_out > 0 && op.kernel > 0 && op.kernel % 2 == 1;
+    } else if (op.type != NN_OP_VALUE) {
+      valid = valid && op.ch_in <= buffer_channels[op.out] &&
+	(op.type != NN_OP_ADD || op.ch_in <= buffer_channels[op.in1]);
+    }
+    if (!valid) {
+      cerr << "Invalid operation : " << filename << endl;
+      exit(1);
+    }
+
+    switch (op.type) {
+      case NN_OP_CONV:
+	ReadFloats(fp, filename, op.weight, (size_t)op.ch_out * op.ch_in * op.kernel * op.kernel);
+	break;
+      case NN_OP_SCALE_SHIFT:
+	ReadFloats(fp, filename, op.weight, op.ch_in);
+	ReadFloats(fp, filename, op.bias, op.ch_in);
+	break;
+      case NN_OP_VALUE:
+	// komi_scale, sum_scale
+	ReadFloats(fp, filename, op.weight, 2);
+	break;
+      default:
+	break;
+    }
+  }
+  fclose(fp);
+
+  if (model != NN_MODEL_POLICY) {
+    SetInputSize(NN_COLOR, 1);
+    SetInputSize(NN_KOMI, 1);
+  }
+  for (size_t i = 0; i < output_id.size(); i++) {
+    const int ch = buffer_channels[output_buffer[i]];
+    SetOutputSize(output_id[i], ch == 0 ? 1 : ch * plane);
+  }
+
+  if (cpu_precision != NN_PRECISION_FP32) {
+    Quantize();
+    if (!cpu_calibration.empty()) {
+      Calibrate(cpu_calibration);
+    }
+    precision = cpu_precision;
+    if (precision == NN_PRECISION_FP16) {
+      for (nn_op_t &op : ops) {
+	if (!op.weight_half.empty()) {
+	  vector<float>().swap(op.weight);
+	}
+      }
+    }
+  }
+}
+
+
+////////////////////////
+//  重みの量子化      //
+////////////////////////
+void
+CpuEvaluator::Quantize( void )
+{
+  // 入力が非負のバッファ (入力の特徴はすべて0以上)
+  vector<bool> nonneg(buffer.size(), false);
+  nonneg[0] = true;
+
+  for (nn_op_t &op : ops) {
+    op.quantized = false;
+    op.input_scale = 0.0f;
+
+    if (op.type == NN_OP_CONV) {
+      const int k = op.ch_in * op.kernel * op.kernel;
+
+      if (cpu_precision == NN_PRECISION_FP16) {
+	op.weight_half.resize(op.weight.size());
+	for (size_t i = 0; i < op.weight.size(); i++) {
+	  op.weight_half[i] = FloatToHalf(op.weight[i]);
+	}
+      } else if (nonneg[op.in0]) {
+	op.quantized = true;
+	op.k_pad = (k + 3) & ~3;
+	op.weight_q.assign((size_t)op.ch_out * op.k_pad, 0);
+	op.weight_scale.resize(op.ch_out);
+	for (int o = 0; o < op.ch_out; o++) {
+	  const float *w = &op.weight[(size_t)o * k];
+	  float w_max = 0.0f;
+	  for (int i = 0; i < k; i++) {
+	    w_max = max(w_max, fabs(w[i]));
+	  }
+	  const float scale = w_max > 0.0f ? w_max / 127.0f : 1.0f;
+	  for (int i = 0; i < k; i++) {
+	    op.weight_q[(size_t)o * op.k_pad + i] = (int8_t)lrint(w[i] / scale);
+	  }
+	  op.weight_scale[o] = scale;
+	}
+	quant_k_pad = max(quant_k_pad, op.k_pad);
+	quant_channels = max(quant_channels, max(op.ch_in, op.ch_out));
+      }
+    }
+
+    if (op.type != NN_OP_VALUE) {
+      nonneg[op.out] = (op.type == NN_OP_RELU || op.type == NN_OP_SIGMOID ||
+			(op.type == NN_OP_ADD && nonneg[op.in0] && nonneg[op.in1]));
+    }
+  }
+}
+
+
+//////////////////////////////////
+//  キャリブレーション用の局面  //
+//////////////////////////////////
+// DumpFeature (Gtp.cpp) が書き出す CNTK Text Format の1行を読む
+static bool
+ReadDumpedPosition( istream &in, vector<float> data[NN_INPUT_MAX], const size_t size[NN_INPUT_MAX] )
+{
+  string line;
+
+  if (!getline(in, line)) return false;
+
+  for (int i = 0; i < NN_INPUT_MAX; i++) {
+    data[i].assign(max(size[i], (size_t)1), 0.0f);
+  }
+
+  stringstream fields(line);
+  string field;
+  while (getline(fields, field, '|')) {
+    stringstream values(field);
+    string name;
+    values >> name;
+
+    int id = -1;
+    for (int i = 0; i < NN_INPUT_MAX; i++) {
+      string input_name(nn_input_name[i].begin(), nn_input_name[i].end());
+      if (name == input_name) id = i;
+    }
+    if (id < 0) continue;
+
+    string value;
+    while (values >> value) {
+      const size_t colon = value.find(':');
+      if (colon == string::npos) {
+	data[id][0] = (float)atof(value.c_str());
+      } else {
+	const size_t index = atoi(value.substr(0, colon).c_str());
+	if (index < data[id].size()) {
+	  data[id][index] = (float)atof(value.substr(colon + 1).c_str());
+	}
+      }
+    }
+  }
+
+  return true;
+}
+
+
+//////////////////////////
+//  キャリブレーション  //
+//////////////////////////
+void
+CpuEvaluator::Calibrate( const string &filename )
+{
+  ifstream in(filename);
+  if (!in) {
+    cerr << "can not open -" << filename << "-" << endl;
+    exit(1);
+  }
+
+  vector<float> position[NN_INPUT_MAX];
+  vector<vector<float>> inputs[NN_INPUT_MAX];
+  while (inputs[0].size() < CALIBRATION_MAX && ReadDumpedPosition(in, position, input_size)) {
+    for (int i = 0; i < NN_INPUT_MAX; i++) {
+      inputs[i].push_back(position[i]);
+    }
+  }
+  const int num = inputs[0].size();
+  if (num == 0) {
+    cerr << "No positions in " << filename << endl;
+    exit(1);
+  }
+
+  Reserve(1);
+
+  // FP32で評価して畳み込みの入力の最大値を調べる
+  vector<float> max_input(ops.size(), 0.0f);
+  vector<vector<float>> expected[NN_OUTPUT_MAX];
+  precision = NN_PRECISION_FP32;
+  input_max = &max_input;
+  for (int n = 0; n < num; n++) {
+    for (int i = 0; i < NN_INPUT_MAX; i++) {
+      if (input_size[i] > 0) SetInput((NN_INPUT)i, 0, inputs[i][n]);
+    }
+    Forward(1);
+    for (int o = 0; o < NN_OUTPUT_MAX; o++) {
+      expected[o].emplace_back(output_data[o].begin(), output_data[o].begin() + output_size[o]);
+    }
+  }
+  input_max = nullptr;
+
+  for (size_t i = 0; i < ops.size(); i++) {
+    if (ops[i].quantized && max_input[i] > 0.0f) {
+      ops[i].input_scale = max_input[i] / 127.0f;
+    }
+  }
+
+  // FP16/INT8とFP32の出力を比べる
+  precision = cpu_precision;
+  int agree = 0;
+  double error = 0.0;
+  for (int n = 0; n < num; n++) {
+    for (int i = 0; i < NN_INPUT_MAX; i++) {
+      if (input_size[i] > 0) SetInput((NN_INPUT)i, 0, inputs[i][n]);
+    }
+    Forward(1);
+    if (output_size[NN_OUTPUT_POLICY] > 0) {
+      const float *out = Output(NN_OUTPUT_POLICY);
+      const vector<float> &e = expected[NN_OUTPUT_POLICY][n];
+      if (max_element(out, out + e.size()) - out == max_element(e.begin(), e.end()) - e.begin()) {
+	agree++;
+      }
+    }
+    if (output_size[NN_OUTPUT_VALUE] > 0) {
+      const float d = Output(NN_OUTPUT_VALUE)[0] - expected[NN_OUTPUT_VALUE][n][0];
+      error += d * d;
+    }
+  }
+
+  cerr << (precision == NN_PRECISION_INT8 ? "INT8" : "FP16") << " calibration : " << num << " positions";
+  if (output_size[NN_OUTPUT_POLICY] > 0) {
+    cerr << ", top-1 agreement " << 100.0 * agree / num << "%";
+  }
+  if (output_size[NN_OUTPUT_VALUE] > 0) {
+    cerr << ", value MSE " << error / num;
+  }
+  cerr << endl;
+}
+
+
+//////////////
+//  行列積  //
+//////////////
+// c(m x n) = a(m x k) b(k x n), aの行の長さはlda
+// a : float または半精度 (uint16_t)
+// b : [n / GEMM_NR][k][GEMM_NR] (列をGEMM_NR列ずつ並べる)
+// kはGEMM_KC以下, nはGEMM_NRの倍数
+// accumulateならcに足し込む
+template <typename T>
+static void
+Gemm( int m, int n, int k, const T *a, int lda, const float *b, float *c, bool accumulate )
+{
+  float tile[GEMM_KC * GEMM_MR];
+  float row[GEMM_KC];
+
+  // bをGEMM_NC列ずつ区切り, aのk列とbの区切りをキャッシュに置く
+  for (int j0 = 0; j0 < n; j0 += GEMM_NC) {
+    const int j1 = min(n, j0 + GEMM_NC);
+
+    for (int i = 0; i < m; i += GEMM_MR) {
+      const int mr = min(GEMM_MR, m - i);
+
+      // aのGEMM_MR行をfloatにして [k][GEMM_MR] に並べ, bのGEMM_NC列で使い回す
+      for (int r = 0; r < GEMM_MR; r++) {
+	const float *ar = r < mr ? WidenWeights(a + (size_t)(i + r) * lda, row, k) : nullptr;
+	for (int kk = 0; kk < k; kk++) {
+	  tile[kk * GEMM_MR + r] = r < mr ? ar[kk] : 0.0f;
+	}
+      }
+
+      // cのGEMM_MR x GEMM_NRをレジスタに置いて計算する
+      for (int j = j0; j < j1; j += GEMM_NR) {
+	const float *bj = b + (size_t)j * k;
+#if defined (__AVX512F__)
+	__m512 sum[GEMM_MR][2];
+	for (int r = 0; r < GEMM_MR; r++) {
+	  if (accumulate && r < mr) {
+	    sum[r][0] = _mm512_loadu_ps(c + (size_t)(i + r) * n + j);
+	    sum[r][1] = _mm512_loadu_ps(c + (size_t)(i + r) * n + j + 16);
+	  } else {
+	    sum[r][0] = sum[r][1] = _mm512_setzero_ps();
+	  }
+	}
+	for (int kk = 0; kk < k; kk++) {
+	  const __m512 b0 = _mm512_loadu_ps(bj + kk * GEMM_NR);
+	  const __m512 b1 = _mm512_loadu_ps(bj + kk * GEMM_NR + 16);
+	  for (int r = 0; r < GEMM_MR; r++) {
+	    const __m512 ar = _mm512_set1_ps(tile[kk * GEMM_MR + r]);
+	    sum[r][0] = _mm512_fmadd_ps(ar, b0, sum[r][0]);
+	    sum[r][1] = _mm512_fmadd_ps(ar, b1, sum[r][1]);
+	  }
+	}
+	for (int r = 0; r < mr; r++) {
+	  _mm512_storeu_ps(c + (size_t)(i + r) * n + j, sum[r][0]);
+	  _mm512_storeu_ps(c + (size_t)(i + r) * n + j + 16, sum[r][1]);
+	}
+#elif defined (__AVX2__) && defined (__FMA__)
+	__m256 sum[GEMM_MR][2];
+	for (int r = 0; r < GEMM_MR; r++) {
+	  if (accumulate && r < mr) {
+	    sum[r][0] = _mm256_loadu_ps(c + (size_t)(i + r) * n + j);
+	    sum[r][1] = _mm256_loadu_ps(c + (size_t)(i + r) * n + j + 8);
+	  } else {
+	    sum[r][0] = sum[r][1] = _mm256_setzero_ps();
+	  }
+	}
+	for (int kk = 0; kk < k; kk++) {
+	  const __m256 b0 = _mm256_loadu_ps(bj + kk * GEMM_NR);
+	  const __m256 b1 = _mm256_loadu_ps(bj + kk * GEMM_NR + 8);
+	  for (int r = 0; r < GEMM_MR; r++) {
+	    const __m256 ar = _mm256_broadcast_ss(&tile[kk * GEMM_MR + r]);
+	    sum[r][0] = _mm256_fmadd_ps(ar, b0, sum[r][0]);
+	    sum[r][1] = _mm256_fmadd_ps(ar, b1, sum[r][1]);
+	  }
+	}
+	for (int r = 0; r < mr; r++) {
+	  _mm256_storeu_ps(c + (size_t)(i + r) * n + j, sum[r][0]);
+	  _mm256_storeu_ps(c + (size_t)(i + r) * n + j + 8, sum[r][1]);
+	}
+#elif defined (__SSE2__) || defined (_M_X64)
+	__m128 sum[GEMM_MR][GEMM_NR / 4];
+	for (int r = 0; r < GEMM_MR; r++) {
+	  for (int x = 0; x < GEMM_NR / 4; x++) {
+	    sum[r][x] = (accumulate && r < mr) ? _mm_loadu_ps(c + (size_t)(i + r) * n + j + x * 4) : _mm_setzero_ps();
+	  }
+	}
+	for (int kk = 0; kk < k; kk++) {
+	  __m128 bk[GEMM_NR / 4];
+	  for (int x = 0; x < GEMM_NR / 4; x++) {
+	    bk[x] = _mm_loadu_ps(bj + kk * GEMM_NR + x * 4);
+	  }
+	  for (int r = 0; r < GEMM_MR; r++) {
+	    const __m128 ar = _mm_set1_ps(tile[kk * GEMM_MR + r]);
+	    for (int x = 0; x < GEMM_NR / 4; x++) {
+	      sum[r][x] = _mm_add_ps(sum[r][x], _mm_mul_ps(ar, bk[x]));
+	    }
+	  }
+	}
+	for (int r = 0; r < mr; r++) {
+	  for (int x = 0; x < GEMM_NR / 4; x++) {
+	    _mm_storeu_ps(c + (size_t)(i + r) * n + j + x * 4, sum[r][x]);
+	  }
+	}
+#else
+	for (int r = 0; r < mr; r++) {
+	  if (!accumulate) fill_n(c + (size_t)(i + r) * n + j, GEMM_NR, 0.0f);
+	}
+	for (int kk = 0; kk < k; kk++) {
+	  const float *bk = bj + kk * GEMM_NR;
+	  for (int r = 0; r < mr; r++) {
+	    const float ar = tile[kk * GEMM_MR + r];
+	    float *cr = c + (size_t)(i + r) * n + j;
+	    for (int x = 0; x < GEMM_NR; x++) {
+	      cr[x] += ar * bk[x];
+	    }
+	  }
+	}
+#endif
+      }
+    }
+  }
+}
+
+
+//////////////////
+//  畳み込み    //
+//////////////////
+// in, out : [チャンネル][columns] (局面毎にplane列ずつ並べる)
+// weight : float または半精度 (行列積の中でfloatにする)
+template <typename T>
+void
+CpuEvaluator::Convolution( const nn_op_t &op, const T *weight, const float *in, float *out, int num )
+{
+  const int k = op.kernel;
+  const int r = k / 2;
+  const int rows = op.ch_in * k * k;
+
+  // 入力の行をGEMM_KC行ずつ区切り, 局面をまとめて1回の行列積にする
+  for (int k0 = 0; k0 < rows; k0 += GEMM_KC) {
+    const int k1 = min(rows, k0 + GEMM_KC);
+
+    for (int row = k0; row < k1; row++) {
+      const float *src_row = in + (size_t)row * columns;
+
+      if (k > 1) {
+	// im2col (盤外と端数の列は0)
+	const int c = row / (k * k);
+	const int dy = row / k % k - r, dx = row % k - r;
+	const int x0 = max(0, -dx), x1 = min(width, width - dx);
+	for (int n = 0; n < num; n++) {
+	  const float *src = in + (size_t)c * columns + n * plane;
+	  float *d = &col_row[n * plane];
+	  for (int y = 0; y < width; y++, d += width) {
+	    const int sy = y + dy;
+	    if (sy < 0 || sy >= width) {
+	      fill_n(d, width, 0.0f);
+	    } else {
+	      fill_n(d, x0, 0.0f);
+	      copy_n(src + sy * width + x0 + dx, x1 - x0, d + x0);
+	      fill_n(d + x1, width - x1, 0.0f);
+	    }
+	  }
+	}
+	fill_n(&col_row[num * plane], columns - num * plane, 0.0f);
+	src_row = col_row.data();
+      }
+
+      // 行列積の並びに詰める
+      for (int j = 0; j < columns; j += GEMM_NR) {
+	copy_n(src_row + j, GEMM_NR, &col[((size_t)j * (k1 - k0) / GEMM_NR + row - k0) * GEMM_NR]);
+      }
+    }
+
+    Gemm(op.ch_out, columns, k1 - k0, weight + k0, rows, col.data(), out, k0 > 0);
+  }
+}
+
+
+//////////////////////////
+//  行列積 (INT8)       //
+//////////////////////////
+// c(m x n) = a(m x k) b(k x n)
+// a : [m][k], b : [n/8][k/4][8][4] (8列ずつ, 4つずつ並べる), n, kは8, 4の倍数
+static void
+GemmInt8( int m, int n, int k, const int8_t *a, const uint8_t *b, int32_t *c )
+{
+  const int kq = k / 4;
+
+  // bの8列をキャッシュに置き, aの全ての行で使い回す
+  for (int j = 0; j < n; j += 8) {
+    const uint8_t *bj = b + (size_t)j * k;
+    int i = 0;
+
+#if defined (__AVX2__)
+#if !defined (__AVX512VNNI__) || !defined (__AVX512VL__)
+    const __m256i ones = _mm256_set1_epi16(1);
+#endif
+
+    for (; i + 4 <= m; i += 4) {
+      const int32_t *a0 = (const int32_t *)(a + (size_t)i * k);
+      const int32_t *a1 = (const int32_t *)(a + (size_t)(i + 1) * k);
+      const int32_t *a2 = (const int32_t *)(a + (size_t)(i + 2) * k);
+      const int32_t *a3 = (const int32_t *)(a + (size_t)(i + 3) * k);
+      __m256i c0 = _mm256_setzero_si256();
+      __m256i c1 = _mm256_setzero_si256();
+      __m256i c2 = _mm256_setzero_si256();
+      __m256i c3 = _mm256_setzero_si256();
+      for (int q = 0; q < kq; q++) {
+	const __m256i bv = _mm256_loadu_si256((const __m256i *)(bj + q * 32));
+#if defined (__AVX512VNNI__) && defined (__AVX512VL__)
+	c0 = _mm256_dpbusd_epi32(c0, bv, _mm256_set1_epi32(a0[q]));
+	c1 = _mm256_dpbusd_epi32(c1, bv, _mm256_set1_epi32(a1[q]));
+	c2 = _mm256_dpbusd_epi32(c2, bv, _mm256_set1_epi32(a2[q]));
+	c3 = _mm256_dpbusd_epi32(c3, bv, _mm256_set1_epi32(a3[q]));
+#else
+	// 入力は7bitなので16bitの和は飽和しない
+	c0 = _mm256_add_epi32(c0, _mm256_madd_epi16(_mm256_maddubs_epi16(bv, _mm256_set1_epi32(a0[q])), ones));
+	c1 = _mm256_add_epi32(c1, _mm256_madd_epi16(_mm256_maddubs_epi16(bv, _mm256_set1_epi32(a1[q])), ones));
+	c2 = _mm256_add_epi32(c2, _mm256_madd_epi16(_mm256_maddubs_epi16(bv, _mm256_set1_epi32(a2[q])), ones));
+	c3 = _mm256_add_epi32(c3, _mm256_madd_epi16(_mm256_maddubs_epi16(bv, _mm256_set1_epi32(a3[q])), ones));
+#endif
+      }
+      _mm256_storeu_si256((__m256i *)(c + (size_t)i * n + j), c0);
+      _mm256_storeu_si256((__m256i *)(c + (size_t)(i + 1) * n + j), c1);
+      _mm256_storeu_si256((__m256i *)(c + (size_t)(i + 2) * n + j), c2);
+      _mm256_storeu_si256((__m256i *)(c + (size_t)(i + 3) * n + j), c3);
+    }
+#endif
+
+    for (; i < m; i++) {
+      const int8_t *ai = a + (size_t)i * k;
+      int32_t *ci = c + (size_t)i * n + j;
+      fill_n(ci, 8, 0);
+      for (int q = 0; q < kq; q++) {
+	const int a0 = ai[q * 4], a1 = ai[q * 4 + 1], a2 = ai[q * 4 + 2], a3 = ai[q * 4 + 3];
+	const uint8_t *bq = bj + q * 32;
+	for (int x = 0; x < 8; x++) {
+	  ci[x] += bq[x * 4] * a0 + bq[x * 4 + 1] * a1 + bq[x * 4 + 2] * a2 + bq[x * 4 + 3] * a3;
+	}
+      }
+    }
+  }
+}
+
+
+//////////////////////////
+//  畳み込み (INT8)     //
+//////////////////////////
+void
+CpuEvaluator::ConvolutionInt8( const nn_op_t &op, const float *in, float *out, int num )
+{
+  const int k = op.kernel;
+  const int r = k / 2;
+  float scale[CPU_BATCH_MAX];
+
+  // 入力を局面毎のスケールで7bitに量子化
+  for (int n = 0; n < num; n++) {
+    scale[n] = op.input_scale;
+    if (scale[n] == 0.0f) {
+      float in_max = 0.0f;
+      for (int c = 0; c < op.ch_in; c++) {
+	const float *s = in + (size_t)c * columns + n * plane;
+	for (int p = 0; p < plane; p++) {
+	  in_max = max(in_max, s[p]);
+	}
+      }
+      scale[n] = in_max > 0.0f ? in_max / 127.0f : 1.0f;
+    }
+
+    const float inv = 1.0f / scale[n];
+    for (int c = 0; c < op.ch_in; c++) {
+      const float *s = in + (size_t)c * columns + n * plane;
+      uint8_t *d = &input_q[(size_t)c * columns + n * plane];
+      for (int p = 0; p < plane; p++) {
+	const float q = s[p] * inv + 0.5f;
+	d[p] = q <= 0.0f ? 0 : (q >= 127.0f ? 127 : (uint8_t)q);
+      }
+    }
+  }
+
+  // im2col (盤外と端数は0)
+  // 4行ずつ作り, 行列積の並びに詰める
+  const int rows = op.ch_in * k * k;
+  for (int q = 0; q < op.k_pad / 4; q++) {
+    for (int t = 0; t < 4; t++) {
+      const int row = q * 4 + t;
+      uint8_t *dst = &col_q_rows[(size_t)t * columns];
+      if (row >= rows) {
+	fill_n(dst, columns, 0);
+	continue;
+      }
+      const int c = row / (k * k);
+      const int dy = row / k % k - r, dx = row % k - r;
+      const int x0 = max(0, -dx), x1 = min(width, width - dx);
+      for (int n = 0; n < num; n++) {
+	const uint8_t *src = &input_q[(size_t)c * columns + n * plane];
+	uint8_t *d = dst + n * plane;
+	for (int y = 0; y < width; y++, d += width) {
+	  const int sy = y + dy;
+	  if (sy < 0 || sy >= width) {
+	    fill_n(d, width, 0);
+	  } else {
+	    fill_n(d, x0, 0);
+	    copy_n(src + sy * width + x0 + dx, x1 - x0, d + x0);
+	    fill_n(d + x1, width - x1, 0);
+	  }
+	}
+      }
+      fill_n(dst + num * plane, columns - num * plane, 0);
+    }
+    const uint8_t *r0 = &col_q_rows[0];
+    const uint8_t *r1 = r0 + columns, *r2 = r1 + columns, *r3 = r2 + columns;
+    for (int j = 0; j < columns; j += 8) {
+      uint8_t *d = &col_q[(size_t)j * op.k_pad + q * 32];
+#if defined (__SSE2__) || defined (_M_X64)
+      const __m128i v01 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r0 + j)), _mm_loadl_epi64((const __m128i *)(r1 + j)));
+      const __m128i v23 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r2 + j)), _mm_loadl_epi64((const __m128i *)(r3 + j)));
+      _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(v01, v23));
+      _mm_storeu_si128((__m128i *)(d + 16), _mm_unpackhi_epi16(v01, v23));
+#else
+      for (int x = 0; x < 8; x++) {
+	d[x * 4] = r0[j + x];
+	d[x * 4 + 1] = r1[j + x];
+	d[x * 4 + 2] = r2[j + x];
+	d[x * 4 + 3] = r3[j + x];
+      }
+#endif
+    }
+  }
+
+  GemmInt8(op.ch_out, columns, op.k_pad, op.weight_q.data(), col_q.data(), acc.data());
+
+  for (int o = 0; o < op.ch_out; o++) {
+    for (int n = 0; n < num; n++) {
+      const float s = op.weight_scale[o] * scale[n];
+      const int32_t *a = &acc[(size_t)o * columns + n * plane];
+      float *d = out + (size_t)o * columns + n * plane;
+      for (int p = 0; p < plane; p++) {
+	d[p] = a[p] * s;
+      }
+    }
+  }
+}
+
+
+//////////////
+//  評価    //
+//////////////
+void
+CpuEvaluator::Run( int num_req )
+{
+  for (int n = 0; n < num_req; n += CPU_BATCH_MAX) {
+    RunBatch(n, min(CPU_BATCH_MAX, num_req - n));
+  }
+}
+
+
+// first番目からnum局面をまとめて評価
+// バッファは [チャンネル][columns] で, 局面毎にplane列ずつ並べる
+// (チャンネル数0のバッファは局面毎に1つの値)
+void
+CpuEvaluator::RunBatch( int first, int num )
+{
+  columns = Columns(num);
+
+  // 入力を連結
+  int channel = 0;
+  for (size_t i = 0; i < input_id.size(); i++) {
+    const NN_INPUT id = input_id[i];
+    for (int c = 0; c < input_channels[i]; c++, channel++) {
+      float *in = buffer[0].data() + (size_t)channel * columns;
+      for (int n = 0; n < num; n++) {
+	copy_n(input_data[id].begin() + (first + n) * input_size[id] + c * plane, plane, in + n * plane);
+      }
+      fill_n(in + num * plane, columns - num * plane, 0.0f);
+    }
+  }
+
+  for (size_t i = 0; i < ops.size(); i++) {
+    const nn_op_t &op = ops[i];
+    const float *src = buffer[op.in0].data();
+    float *dst = buffer[op.out].data();
+    const size_t size = (size_t)max(op.ch_in, 1) * columns;
+
+    switch (op.type) {
+      case NN_OP_CONV:
+	if (input_max != nullptr) {
+	  float &m = (*input_max)[i];
+	  for (int c = 0; c < op.ch_in; c++) {
+	    for (int p = 0; p < num * plane; p++) {
+	      m = max(m, src[(size_t)c * columns + p]);
+	    }
+	  }
+	}
+	if (precision == NN_PRECISION_INT8 && op.quantized) {
+	  ConvolutionInt8(op, src, dst, num);
+	} else if (precision == NN_PRECISION_FP16) {
+	  Convolution(op, op.weight_half.data(), src, dst, num);
+	} else {
+	  Convolution(op, op.weight.data(), src, dst, num);
+	}
+	break;
+      case NN_OP_SCALE_SHIFT:
+	for (int c = 0; c < op.ch_in; c++) {
+	  const float a = op.weight[c], b = op.bias[c];
+	  const float *s = src + (size_t)c * columns;
+	  float *d = dst + (size_t)c * columns;
+	  for (int p = 0; p < columns; p++) {
+	    d[p] = a * s[p] + b;
+	  }
+	}
+	break;
+      case NN_OP_RELU:
+	for (size_t p = 0; p < size; p++) {
+	  dst[p] = max(src[p], 0.0f);
+	}
+	break;
+      case NN_OP_TANH:
+	for (size_t p = 0; p < size; p++) {
+	  dst[p] = tanh(src[p]);
+	}
+	break;
+      case NN_OP_SIGMOID:
+	for (size_t p = 0; p < size; p++) {
+	  dst[p] = 1.0f / (1.0f + exp(-src[p]));
+	}
+	break;
+      case NN_OP_ADD: {
+	const float *src1 = buffer[op.in1].data();
+	for (size_t p = 0; p < size; p++) {
+	  dst[p] = src[p] + src1[p];
+	}
+	break;
+      }
+      case NN_OP_VALUE:
+	// p = tanh((ΣV + (2 color - 1) komi komi_scale) * 0.01 sum_scale)
+	for (int n = 0; n < num; n++) {
+	  const float color = input_data[NN_COLOR][first + n];
+	  const float komi = input_data[NN_KOMI][first + n];
+	  float sum = 0.0f;
+	  for (int p = 0; p < plane; p++) {
+	    sum += src[n * plane + p];
+	  }
+	  sum += (color * 2 - 1) * komi * op.weight[0];
+	  dst[n] = tanh(sum * 0.01f * op.weight[1]);
+	}
+	break;
+    }
+  }
+
+  for (size_t i = 0; i < output_id.size(); i++) {
+    const NN_OUTPUT id = output_id[i];
+    const int ch = buffer_channels[output_buffer[i]];
+    const float *out = buffer[output_buffer[i]].data();
+    for (int n = 0; n < num; n++) {
+      float *d = &output_data[id][(first + n) * output_size[id]];
+      if (ch == 0) {
+	d[0] = out[n];
+      }
+      for (int c = 0; c < ch; c++) {
+	copy_n(out + (size_t)c * columns + n * plane, plane, d + c * plane);
+      }
+    }
+  }
+}
+
+
+//////////////////////////////
+//  バッファの確保          //
+//////////////////////////////
+void
+CpuEvaluator::Reallocated( void )
+{
+  const int cols = Columns(min(capacity, CPU_BATCH_MAX));
+
+  for (size_t i = 0; i < buffer.size(); i++) {
+    buffer[i].resize((size_t)max(buffer_channels[i], 1) * cols);
+  }
+  col.resize((size_t)GEMM_KC * cols);
+  col_row.resize(cols);
+  input_q.resize((size_t)quant_channels * cols);
+  col_q.resize((size_t)quant_k_pad * cols);
+  col_q_rows.resize((size_t)4 * cols);
+  acc.resize((size_t)quant_channels * cols);
+}
+
+
+unique_ptr<Evaluator>
+CreateCpuEvaluator( NN_MODEL model, const string &path )
+{
+  const string filename = path + "/" + ModelFileName(NN_BACKEND_CPU, model);
+
+  return unique_ptr<Evaluator>(new CpuEvaluator(model, filename));
+}
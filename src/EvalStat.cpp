@@ -0,0 +1,299 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "EvalStat.h"
+
+using namespace std;
+
+
+////////////
+//  定数  //
+////////////
+
+static const char *eval_kind_name[EVAL_KIND_MAX] = {
+  "policy",
+  "value",
+};
+
+static const char *eval_batch_class_name[EVAL_BATCH_CLASS_MAX] = {
+  "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65-128", "129-",
+};
+
+
+////////////////
+//  大域変数  //
+////////////////
+
+// トレースの出力先
+static FILE *trace_file = nullptr;
+static bool trace_json = false;
+static ray_clock::time_point trace_begin;
+static mutex mutex_trace;
+
+
+//////////////////////////
+//  バッチサイズの区分  //
+//////////////////////////
+static int
+BatchClass( const int batch_size )
+{
+  int c = 0;
+
+  while (c < EVAL_BATCH_CLASS_MAX - 1 && (1 << c) < batch_size) {
+    c++;
+  }
+
+  return c;
+}
+
+
+//////////////////////
+//  時間の区分      //
+//////////////////////
+static int
+TimeBin( const double sec )
+{
+  int bin = 0;
+  double us = sec * 1e6;
+
+  while (bin < EVAL_TIME_BINS - 1 && us >= 2.0) {
+    us /= 2;
+    bin++;
+  }
+
+  return bin;
+}
+
+
+//////////////////////////////////////
+//  ヒストグラムのパーセンタイル    //
+//  (区分の中央の値, 秒)            //
+//////////////////////////////////////
+static double
+Percentile( const long long *hist, const double rate )
+{
+  long long count = 0, sum = 0;
+
+  for (int i = 0; i < EVAL_TIME_BINS; i++) {
+    count += hist[i];
+  }
+  if (count == 0) {
+    return 0.0;
+  }
+
+  for (int i = 0; i < EVAL_TIME_BINS; i++) {
+    sum += hist[i];
+    if (sum >= count * rate) {
+      return ldexp(1.0, i) * sqrt(2.0) * 1e-6;
+    }
+  }
+
+  return ldexp(1.0, EVAL_TIME_BINS) * 1e-6;
+}
+
+
+static inline double
+Seconds( const ray_clock::time_point &from, const ray_clock::time_point &to )
+{
+  return chrono::duration<double>(to - from).count();
+}
+
+
+EvalStat::EvalStat()
+  : active_threads(0)
+{
+  Clear();
+}
+
+
+//////////////////////
+//  統計のクリア    //
+//////////////////////
+void
+EvalStat::Clear()
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  memset(batches, 0, sizeof(batches));
+  memset(requests, 0, sizeof(requests));
+  memset(forward_hist, 0, sizeof(forward_hist));
+  memset(wait_hist, 0, sizeof(wait_hist));
+  memset(total_hist, 0, sizeof(total_hist));
+  busy_time = active_time = 0;
+  active_start = ray_clock::now();
+  search_waits = 0;
+  search_wait_time = 0;
+  batch_id = 0;
+}
+
+
+//////////////////////////////////
+//  評価スレッドの開始と終了    //
+//////////////////////////////////
+void
+EvalStat::Start()
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  if (active_threads++ == 0) {
+    active_start = ray_clock::now();
+  }
+}
+
+void
+EvalStat::Stop()
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  if (--active_threads == 0) {
+    active_time += Seconds(active_start, ray_clock::now());
+  }
+}
+
+
+//////////////////////////
+//  バッチの評価の記録  //
+//////////////////////////
+long long
+EvalStat::RecordBatch( EVAL_KIND kind, int batch_size, const ray_clock::time_point &start, const ray_clock::time_point &forward_done )
+{
+  lock_guard<mutex> lock(mutex_stat);
+  const int c = BatchClass(batch_size);
+  const double sec = Seconds(start, forward_done);
+
+  batches[kind][c]++;
+  forward_hist[kind][c][TimeBin(sec)]++;
+  busy_time += sec;
+
+  return ++batch_id;
+}
+
+
+//////////////////////
+//  要求の時刻の記録  //
+//////////////////////
+void
+EvalStat::RecordRequest( EVAL_KIND kind, long long batch, int batch_size, const eval_timestamp_t &time )
+{
+  {
+    lock_guard<mutex> lock(mutex_stat);
+    const int c = BatchClass(batch_size);
+
+    requests[kind]++;
+    wait_hist[kind][c][TimeBin(Seconds(time.enqueue, time.batch_start))]++;
+    total_hist[kind][TimeBin(Seconds(time.enqueue, time.backup_done))]++;
+  }
+
+  if (trace_file == nullptr) {
+    return;
+  }
+
+  // 時刻はトレースを開いた時からのマイクロ秒
+  lock_guard<mutex> lock(mutex_trace);
+  const long long enqueue = chrono::duration_cast<chrono::microseconds>(time.enqueue - trace_begin).count();
+  const long long batch_start = chrono::duration_cast<chrono::microseconds>(time.batch_start - trace_begin).count();
+  const long long forward_done = chrono::duration_cast<chrono::microseconds>(time.forward_done - trace_begin).count();
+  const long long backup_done = chrono::duration_cast<chrono::microseconds>(time.backup_done - trace_begin).count();
+
+  if (trace_json) {
+    fprintf(trace_file, "{\"kind\":\"%s\",\"batch\":%lld,\"batch_size\":%d,\"enqueue\":%lld,\"batch_start\":%lld,\"forward_done\":%lld,\"backup_done\":%lld}\n",
+	    eval_kind_name[kind], batch, batch_size, enqueue, batch_start, forward_done, backup_done);
+  } else {
+    fprintf(trace_file, "%s,%lld,%d,%lld,%lld,%lld,%lld\n",
+	    eval_kind_name[kind], batch, batch_size, enqueue, batch_start, forward_done, backup_done);
+  }
+}
+
+
+//////////////////////////////////
+//  探索スレッドの待ちの記録    //
+//////////////////////////////////
+void
+EvalStat::RecordSearchWait( double sec )
+{
+  lock_guard<mutex> lock(mutex_stat);
+
+  search_waits++;
+  search_wait_time += sec;
+}
+
+
+//////////////////
+//  状態の出力  //
+//////////////////
+void
+EvalStat::Print( ostream &out ) const
+{
+  lock_guard<mutex> lock(mutex_stat);
+  const double active = active_time + (active_threads > 0 ? Seconds(active_start, ray_clock::now()) : 0.0);
+
+  out << std::fixed << setprecision(2);
+  for (int kind = 0; kind < EVAL_KIND_MAX; kind++) {
+    long long total_hist_count = 0;
+    for (int i = 0; i < EVAL_TIME_BINS; i++) {
+      total_hist_count += total_hist[kind][i];
+    }
+    out << eval_kind_name[kind] << " : " << requests[kind] << " requests";
+    if (total_hist_count > 0) {
+      out << ", latency p50 " << Percentile(total_hist[kind], 0.5) * 1000 << " ms";
+      out << " p99 " << Percentile(total_hist[kind], 0.99) * 1000 << " ms";
+    }
+    out << endl;
+    for (int c = 0; c < EVAL_BATCH_CLASS_MAX; c++) {
+      if (batches[kind][c] == 0) {
+	continue;
+      }
+      out << "  batch " << setw(6) << eval_batch_class_name[c] << " : " << setw(7) << batches[kind][c] << " batches";
+      out << ", forward p50 " << Percentile(forward_hist[kind][c], 0.5) * 1000;
+      out << " p99 " << Percentile(forward_hist[kind][c], 0.99) * 1000 << " ms";
+      out << ", wait p50 " << Percentile(wait_hist[kind][c], 0.5) * 1000;
+      out << " p99 " << Percentile(wait_hist[kind][c], 0.99) * 1000 << " ms" << endl;
+    }
+  }
+
+  // 稼働率が高くて探索スレッドが待っていればNNが足りず,
+  // 稼働率が低ければ探索スレッドが足りない
+  out << setprecision(1);
+  out << "evaluator : " << (active > 0 ? busy_time / active * 100 : 0.0) << " % busy";
+  out << " (" << busy_time << " / " << active << " s)";
+  out << ", search waits " << search_waits << " (" << search_wait_time << " s)" << endl;
+}
+
+
+//////////////////////////////////////
+//  評価要求のトレースの出力先      //
+//////////////////////////////////////
+void
+SetEvalTraceFile( const string &filename )
+{
+  lock_guard<mutex> lock(mutex_trace);
+
+  if (trace_file != nullptr) {
+    fclose(trace_file);
+    trace_file = nullptr;
+  }
+
+#if defined (_WIN32)
+  if (fopen_s(&trace_file, filename.c_str(), "w") != 0) {
+    trace_file = nullptr;
+  }
+#else
+  trace_file = fopen(filename.c_str(), "w");
+#endif
+  if (trace_file == nullptr) {
+    cerr << "can not open -" << filename << "-" << endl;
+    exit(1);
+  }
+
+  const size_t ext = filename.rfind('.');
+  trace_json = ext != string::npos && filename.substr(ext) == ".json";
+  trace_begin = ray_clock::now();
+
+  if (!trace_json) {
+    fprintf(trace_file, "kind,batch,batch_size,enqueue,batch_start,forward_done,backup_done\n");
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef _EVALSTAT_H_
+#define _EVALSTAT_H_
+
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "Utility.h"
+
+
+////////////
+//  定数  //
+////////////
+
+// 評価の種類
+enum EVAL_KIND {
+  EVAL_POLICY,
+  EVAL_VALUE,
+  EVAL_KIND_MAX,
+};
+
+// バッチサイズの区分 (1, 2, 3-4, 5-8, ..., 129-)
+const int EVAL_BATCH_CLASS_MAX = 9;
+
+// 時間の区分 (1us, 2us, 4us, ... の2倍毎)
+const int EVAL_TIME_BINS = 25;
+
+
+//////////////
+//  構造体  //
+//////////////
+
+// 評価要求の時刻
+struct eval_timestamp_t {
+  ray_clock::time_point enqueue;       // キューに入れた
+  ray_clock::time_point batch_start;   // バッチの評価を始めた
+  ray_clock::time_point forward_done;  // NNの評価が終わった
+  ray_clock::time_point backup_done;   // 結果を探索木に反映した
+};
+
+
+//////////////
+//  クラス  //
+//////////////
+
+// NN評価の計測
+// 要求のキューでの待ち時間とバッチの評価時間をバッチサイズ毎の
+// ヒストグラムにし, 評価器の稼働率と探索スレッドの待ち時間を集計する
+class EvalStat {
+public:
+  EvalStat();
+
+  //  統計のクリア
+  void Clear();
+
+  //  評価スレッドの開始と終了 (稼働率の分母)
+  void Start();
+  void Stop();
+
+  //  1バッチの評価を記録してバッチ番号を返す
+  long long RecordBatch( EVAL_KIND kind, int batch_size, const ray_clock::time_point &start, const ray_clock::time_point &forward_done );
+
+  //  1要求の時刻を記録
+  void RecordRequest( EVAL_KIND kind, long long batch, int batch_size, const eval_timestamp_t &time );
+
+  //  探索スレッドがキューの空きを待った時間を記録
+  void RecordSearchWait( double sec );
+
+  //  状態の出力
+  void Print( std::ostream &out ) const;
+
+private:
+  long long batches[EVAL_KIND_MAX][EVAL_BATCH_CLASS_MAX];
+  long long requests[EVAL_KIND_MAX];
+  long long forward_hist[EVAL_KIND_MAX][EVAL_BATCH_CLASS_MAX][EVAL_TIME_BINS];
+  long long wait_hist[EVAL_KIND_MAX][EVAL_BATCH_CLASS_MAX][EVAL_TIME_BINS];
+  long long total_hist[EVAL_KIND_MAX][EVAL_TIME_BINS];
+
+  // 評価器が動いていた時間と評価していた時間
+  double busy_time, active_time;
+  int active_threads;
+  ray_clock::time_point active_start;
+
+  // 探索スレッドの待ち
+  long long search_waits;
+  double search_wait_time;
+
+  // バッチ番号
+  long long batch_id;
+
+  mutable std::mutex mutex_stat;
+};
+
+
+////////////
+//  関数  //
+////////////
+
+//  評価要求のトレースの出力先 (拡張子が .json ならJSON Lines, それ以外はCSV)
+void SetEvalTraceFile( const std::string &filename );
+
+#endif
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "Evaluator.h"
+
+using namespace std;
+
+
+Evaluator::Evaluator()
+  : capacity(0)
+{
+  fill_n(input_size, NN_INPUT_MAX, 0);
+  fill_n(output_size, NN_OUTPUT_MAX, 0);
+}
+
+
+//////////////////////////
+//  バッファの確保      //
+//////////////////////////
+void
+Evaluator::Reserve( int batch_size )
+{
+  if (batch_size <= capacity)
+    return;
+
+  for (int i = 0; i < NN_INPUT_MAX; i++) {
+    input_data[i].resize(batch_size * input_size[i]);
+  }
+  for (int i = 0; i < NN_OUTPUT_MAX; i++) {
+    output_data[i].resize(batch_size * output_size[i]);
+  }
+  capacity = batch_size;
+
+  Reallocated();
+}
+
+
+//////////////////////
+//  入力の書き込み  //
+//////////////////////
+void
+Evaluator::SetInput( NN_INPUT i, int n, const vector<float>& data )
+{
+  copy_n(data.begin(), min(data.size(), input_size[i]), input_data[i].begin() + n * input_size[i]);
+}
+
+void
+Evaluator::SetInput( NN_INPUT i, int n, float data )
+{
+  if (input_size[i] > 0)
+    input_data[i][n * input_size[i]] = data;
+}
+
+
+//////////////
+//  評価    //
+//////////////
+void
+Evaluator::Forward( int num_req )
+{
+  Reserve(num_req);
+  Run(num_req);
+}
+
+
+//////////////////////////
+//  モデルのファイル名  //
+//////////////////////////
+string
+ModelFileName( NN_BACKEND backend, NN_MODEL model )
+{
+  static const char *name[] = { "model2", "model3", "model" };
+
+  return string(name[model]) + (backend == NN_BACKEND_CNTK ? ".bin" : ".weights");
+}
+
+
+bool
+ExistsModel( NN_BACKEND backend, NN_MODEL model, const string &path )
+{
+  ifstream in(path + "/" + ModelFileName(backend, model), ios::binary);
+  return (bool)in;
+}
+
+
+////////////////////
+//  評価器の生成  //
+////////////////////
+unique_ptr<Evaluator>
+CreateEvaluator( NN_BACKEND backend, NN_MODEL model, const string &path, int device_id )
+{
+  switch (backend) {
+    case NN_BACKEND_CNTK:
+      return CreateCntkEvaluator(model, path, device_id);
+    case NN_BACKEND_CPU:
+      return CreateCpuEvaluator(model, path);
+  }
+
+  cerr << "Unknown NN backend" << endl;
+  abort();
+}
@@ -0,0 +1,138 @@
+#ifndef _EVALUATOR_H_
+#define _EVALUATOR_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+////////////
+//  定数  //
+////////////
+
+// NNの入力
+enum NN_INPUT {
+  NN_BASIC,
+  NN_FEATURES,
+  NN_HISTORY,
+  NN_COLOR,
+  NN_KOMI,
+  NN_SAFETY,
+  NN_INPUT_MAX,
+};
+
+// NNの出力
+enum NN_OUTPUT {
+  NN_OUTPUT_POLICY,	// 着手の評価 (盤面の大きさ)
+  NN_OUTPUT_VALUE,	// 勝率 (-1〜1)
+  NN_OUTPUT_MAX,
+};
+
+// NNのバックエンド
+enum NN_BACKEND {
+  NN_BACKEND_CNTK,
+  NN_BACKEND_CPU,
+};
+
+#if defined (NO_CNTK)
+const NN_BACKEND DEFAULT_NN_BACKEND = NN_BACKEND_CPU;
+#else
+const NN_BACKEND DEFAULT_NN_BACKEND = NN_BACKEND_CNTK;
+#endif
+
+// CPUの評価器の精度
+enum NN_PRECISION {
+  NN_PRECISION_FP32,
+  NN_PRECISION_FP16,
+  NN_PRECISION_INT8,
+};
+
+// 読み込むモデル
+enum NN_MODEL {
+  NN_MODEL_POLICY,
+  NN_MODEL_VALUE,
+  NN_MODEL_DUAL,	// PolicyとValueの2つの出力を持つモデル
+};
+
+const std::wstring nn_input_name[NN_INPUT_MAX] = {
+  L"basic",
+  L"features",
+  L"history",
+  L"color",
+  L"komi",
+  L"safety",
+};
+
+
+//////////////
+//  クラス  //
+//////////////
+
+// NN評価器
+// 入出力のバッファは評価器が持ち, バッチ毎に使い回す
+class Evaluator {
+public:
+  Evaluator();
+  virtual ~Evaluator() {}
+
+  //  バッチサイズの分だけバッファを確保
+  void Reserve( int batch_size );
+
+  //  n番目の局面の入力を設定
+  void SetInput( NN_INPUT i, int n, const std::vector<float>& data );
+  void SetInput( NN_INPUT i, int n, float data );
+
+  //  num_req局面を評価
+  void Forward( int num_req );
+
+  //  出力の先頭
+  const float *Output( NN_OUTPUT o ) const { return output_data[o].data(); }
+
+  //  1局面あたりの出力の大きさ (持たない出力は0)
+  size_t OutputSize( NN_OUTPUT o ) const { return output_size[o]; }
+
+protected:
+  //  1局面あたりの入出力の大きさを設定(使わない入出力は0)
+  void SetInputSize( NN_INPUT i, size_t size ) { input_size[i] = size; }
+  void SetOutputSize( NN_OUTPUT o, size_t size ) { output_size[o] = size; }
+
+  //  バッファを確保し直した
+  virtual void Reallocated() {}
+
+  //  num_req局面を評価してoutput_dataに書き込む
+  virtual void Run( int num_req ) = 0;
+
+  size_t input_size[NN_INPUT_MAX];
+  std::vector<float> input_data[NN_INPUT_MAX];
+  size_t output_size[NN_OUTPUT_MAX];
+  std::vector<float> output_data[NN_OUTPUT_MAX];
+  int capacity;
+};
+
+
+////////////
+//  関数  //
+////////////
+
+//  モデルのファイル名
+std::string ModelFileName( NN_BACKEND backend, NN_MODEL model );
+
+//  モデルのファイルがあるか
+bool ExistsModel( NN_BACKEND backend, NN_MODEL model, const std::string &path );
+
+//  評価器の生成
+std::unique_ptr<Evaluator> CreateEvaluator( NN_BACKEND backend, NN_MODEL model, const std::string &path, int device_id );
+
+//  CNTKの評価器の生成
+std::unique_ptr<Evaluator> CreateCntkEvaluator( NN_MODEL model, const std::string &path, int device_id );
+
+//  CPUの評価器の生成
+std::unique_ptr<Evaluator> CreateCpuEvaluator( NN_MODEL model, const std::string &path );
+
+//  CPUの評価器の精度の設定
+void SetCpuPrecision( NN_PRECISION precision );
+
+//  INT8のキャリブレーションとFP32との比較に使う局面 (_dump で書き出したファイル)
+void SetCpuCalibration( const std::string &filename );
+
+#endif
@@ -12,6 +12,7 @@
 #include "UctSearch.h"
 #include "Ladder.h"
 #include "Rating.h"
+#include "PlayoutStat.h"
 
 using namespace std;
 
@@ -19,6 +20,7 @@ using namespace std;
 //     大域変数    //
 /////////////////////
 
+#if !defined (FIXED_BOARD_SIZE)
 int pure_board_max = PURE_BOARD_MAX;    // 盤のの大きさ    
 int pure_board_size = PURE_BOARD_SIZE;  // 盤の辺の大きさ  
 int board_max = BOARD_MAX;              // 盤外を含む盤の大きさ  
@@ -26,6 +28,7 @@ int board_size = BOARD_SIZE;            // 盤外を含む盤の辺の大きさ
 
 int board_start = BOARD_START;  // 盤の左(上)端
 int board_end = BOARD_END;      //  盤の右(下)端
+#endif
 
 int first_move_candidates;  // 初手の候補手の個数
 
@@ -52,6 +55,8 @@ int border_dis_y[BOARD_MAX];                     // y方向の距離
 int move_dis[PURE_BOARD_SIZE][PURE_BOARD_SIZE];  // 着手距離  
 
 int onboard_pos[PURE_BOARD_MAX];  //  実際の盤上の位置との対応
+int pure_board_index[BOARD_MAX];  //  盤上の位置の番号 (盤外は-1)
+
 int first_move_candidate[PURE_BOARD_MAX]; // 初手の候補手
 
 int corner[4];
@@ -61,6 +66,46 @@ int cross[4];
 
 bool check_superko = false;  // 超劫の確認の設定
 
+// 着手を戻すための座標の記録
+struct undo_pos_t {
+  int pos;
+  int string_id;
+  int string_next;
+  char board;
+  bool candidates;
+};
+
+// 着手を戻すための連の記録
+struct undo_string_t {
+  int id;
+  string_t string;
+};
+
+// 1手分の記録
+struct undo_frame_t {
+  int pos, color;
+  int moves, ko_pos, ko_move, pass_count;
+  int prisoner[S_MAX];
+  int capture_num;
+  int superko_num;
+  unsigned long long current_hash, previous1_hash, previous2_hash;
+  unsigned long long positional_hash, move_hash;
+  unsigned int tactical_features1, tactical_features2;
+  size_t pos_begin, string_begin;  // この手の記録の先頭
+  liberty_set_t saved_pos;         // この手で記録した座標
+  neighbor_set_t saved_string;     // この手で記録した連
+};
+
+// 着手の記録 (スレッド毎に1つの盤面)
+struct undo_journal_t {
+  const game_info_t *game = nullptr;
+  vector<undo_frame_t> frame;
+  vector<undo_pos_t> pos;
+  vector<undo_string_t> string;
+};
+
+static thread_local undo_journal_t undo_journal;
+
 ///////////////
 // 関数宣言  //
 ///////////////
@@ -68,6 +113,15 @@ bool check_superko = false;  // 超劫の確認の設定
 // 4近傍の空点数の初期化
 static void InitializeNeighbor( void );
 
+// 超劫の確認用の局面の集合に含まれるか
+static bool HasSuperKoHash( const game_info_t *game, const unsigned long long hash );
+
+// 超劫の確認用の局面の集合に加える
+static void AddSuperKoHash( game_info_t *game, const unsigned long long hash );
+
+// 超劫の確認用の局面の集合をnum個目まで戻す
+static void TruncateSuperKoHash( game_info_t *game, const int num );
+
 // 眼のパターンの設定
 static void InitializeEye( void );
 
@@ -75,8 +129,7 @@ static void InitializeEye( void );
 static void InitializeTerritory( void );
 
 // ダメ(pos)を連(string)に加える
-// 加えたダメ(pos)を返す
-static int AddLiberty( string_t *string, const int pos, const int head );
+static void AddLiberty( string_t *string, const int pos );
 
 // ダメ(pos)を連(string)から取り除く
 static void RemoveLiberty( game_info_t *game, string_t *string, const int pos );
@@ -108,7 +161,7 @@ static int RemoveString( game_info_t *game, string_t *string );
 static int PoRemoveString( game_info_t *game, string_t *string, const int color );
 
 // 隣接する連IDの追加
-static void AddNeighbor( string_t *string, const int id, const int head );
+static void AddNeighbor( string_t *string, const int id );
 
 // 隣接する連IDの削除
 static void RemoveNeighborString( string_t *string, const int id );
@@ -116,6 +169,31 @@ static void RemoveNeighborString( string_t *string, const int id );
 // 隅のマガリ四目の確認
 static void CheckBentFourInTheCorner( game_info_t *game );
 
+// 盤面以外の情報と小さな配列のコピー
+static void CopyGameState( game_info_t *dst, const game_info_t *src );
+
+// 変更前の座標の情報を記録
+static void SavePos( game_info_t *game, const int pos );
+
+// 変更前の連を記録
+static void SaveString( game_info_t *game, const int id );
+
+// 連IDか連の構成が変わる座標の記録
+static inline void
+TouchPos( game_info_t *game, const int pos )
+{
+  game->dirty_pos.Add(pos);
+  if (game->undo_depth > 0) SavePos(game, pos);
+}
+
+// 変更される連の記録
+static inline void
+TouchString( game_info_t *game, const int id )
+{
+  game->dirty_string.Add(id);
+  if (game->undo_depth > 0) SaveString(game, id);
+}
+
 //  盤端での処理
 static bool IsFalseEyeConnection( const game_info_t *game, const int pos, const int color );
 
@@ -137,6 +215,12 @@ SetBoardSize( const int size )
 {
   int i;
 
+#if defined (FIXED_BOARD_SIZE)
+  if (size != PURE_BOARD_SIZE) {
+    cerr << "board size is fixed to " << PURE_BOARD_SIZE << endl;
+    return;
+  }
+#else
   pure_board_size = size;
   pure_board_max = size * size;
   board_size = size + 2 * OB_SIZE;
@@ -144,10 +228,13 @@ SetBoardSize( const int size )
 
   board_start = OB_SIZE;
   board_end = (pure_board_size + OB_SIZE - 1);
+#endif
 
   i = 0;
+  fill_n(pure_board_index, BOARD_MAX, -1);
   for (int y = board_start; y <= board_end; y++) {
     for (int x = board_start; x <= board_end; x++) {
+      pure_board_index[POS(x, y)] = i;
       onboard_pos[i++] = POS(x, y);
       board_x[POS(x, y)] = x;
       board_y[POS(x, y)] = y;
@@ -267,12 +354,16 @@ InitializeBoard( game_info_t *game )
   memset(game->pat,    0, sizeof(pattern_t) * board_max);
 
   fill_n(game->board, board_max, 0);              
+  fill_n(game->string_id, STRING_POS_MAX, 0);
+  fill_n(game->string_next, STRING_POS_MAX, 0);
   fill_n(game->tactical_features1, board_max, 0);
   fill_n(game->tactical_features2, board_max, 0);
   fill_n(game->update_num,  (int)S_OB, 0);
   fill_n(game->capture_num, (int)S_OB, 0);
   fill(game->update_pos[0],  game->update_pos[S_OB], 0);
   fill(game->capture_pos[0], game->capture_pos[S_OB], 0);
+  fill_n(game->superko_hash, SUPERKO_HASH_SIZE, 0ULL);
+  game->superko_num = 0;
   
   game->current_hash = 0;
   game->previous1_hash = 0;
@@ -308,6 +399,10 @@ InitializeBoard( game_info_t *game )
     game->string[i].flag = false;
   }
 
+  game->dirty_pos.Clear();
+  game->dirty_string.Clear();
+  game->undo_depth = 0;
+
   ClearPattern(game->pat);
 }
 
@@ -366,18 +461,11 @@ ClearBoard( game_info_t *game )
 void
 CopyGame( game_info_t *dst, const game_info_t *src )
 {
-  memcpy(dst->record,             src->record,             sizeof(record_t) * MAX_RECORDS);
-  memcpy(dst->prisoner,           src->prisoner,           sizeof(int) * S_MAX);
-  memcpy(dst->board,              src->board,              sizeof(char) * board_max);  
+  // 着手の記録は手数分だけ
+  memcpy(dst->record,             src->record,             sizeof(record_t) * min(src->moves + 1, MAX_RECORDS));
   memcpy(dst->pat,                src->pat,                sizeof(pattern_t) * board_max); 
   memcpy(dst->string_id,          src->string_id,          sizeof(int) * STRING_POS_MAX);
   memcpy(dst->string_next,        src->string_next,        sizeof(int) * STRING_POS_MAX);
-  memcpy(dst->candidates,         src->candidates,         sizeof(bool) * board_max); 
-  memcpy(dst->capture_num,        src->capture_num,        sizeof(int) * S_OB);
-  memcpy(dst->update_num,         src->update_num,         sizeof(int) * S_OB);
-
-  fill_n(dst->tactical_features1, board_max, 0);
-  fill_n(dst->tactical_features2, board_max, 0);
 
   for (int i = 0; i < MAX_STRING; i++) {
     if (src->string[i].flag) {
@@ -387,6 +475,89 @@ CopyGame( game_info_t *dst, const game_info_t *src )
     }
   }
 
+  dst->dirty_pos.Clear();
+  dst->dirty_string.Clear();
+  dst->undo_depth = 0;
+
+  if (check_superko) {
+    memcpy(dst->superko_hash, src->superko_hash, sizeof(unsigned long long) * SUPERKO_HASH_SIZE);
+    memcpy(dst->superko_slot, src->superko_slot, sizeof(int) * src->superko_num);
+  }
+  dst->superko_num = src->superko_num;
+
+  CopyGameState(dst, src);
+}
+
+
+//////////////////////////////
+//  コピー元の局面に戻す    //
+//////////////////////////////
+void
+RestoreGame( game_info_t *dst, const game_info_t *src )
+{
+  const ray_clock::time_point start_time = PlayoutStatClock();
+  const int first = dst->dirty_pos.Next(-1);
+
+  CountPlayoutStat(PO_RESTORES, 1);
+
+  // 着手の記録はsrcの手数より後ろにしか追加されていないので戻さない
+  // 超劫の確認用の局面の集合も追加された分だけを取り除く
+  TruncateSuperKoHash(dst, src->superko_num);
+
+  // 連IDか連の構成が変わった座標のある行を戻す
+  // 座標の番号は行順なので, 最初と最後の座標で行の範囲が決まる.
+  // プレイアウトの後はほとんどの行が変わっているので,
+  // 1点ずつ戻すより行をまとめて写した方が速い
+  if (first >= 0) {
+    const int last = dst->dirty_pos.Last();
+    const int y_min = board_y[onboard_pos[first]];
+    const int y_max = board_y[onboard_pos[last]];
+    const int begin = POS(0, y_min);
+    const int end = POS(0, y_max + 1);
+
+    CountPlayoutStat(PO_RESTORE_ROWS, y_max - y_min + 1);
+
+    memcpy(&dst->string_id[begin],   &src->string_id[begin],   sizeof(int) * (end - begin));
+    memcpy(&dst->string_next[begin], &src->string_next[begin], sizeof(int) * (end - begin));
+
+    // パターンは石が変わった行から5行以内だけを戻す
+    const int pat_begin = POS(0, max(y_min - 5, 0));
+    const int pat_end = POS(0, min(y_max + 5, board_size - 1) + 1);
+    memcpy(&dst->pat[pat_begin], &src->pat[pat_begin], sizeof(pattern_t) * (pat_end - pat_begin));
+  }
+  dst->dirty_pos.Clear();
+
+  // 変更された連を戻す
+  for (int id = dst->dirty_string.Next(-1); id >= 0; id = dst->dirty_string.Next(id)) {
+    if (src->string[id].flag) {
+      memcpy(&dst->string[id], &src->string[id], sizeof(string_t));
+    } else {
+      dst->string[id].flag = false;
+    }
+  }
+  dst->dirty_string.Clear();
+
+  CopyGameState(dst, src);
+
+  CountPlayoutStatTime(PO_RESTORE_TIME, start_time);
+}
+
+
+////////////////////////////////////////
+//  盤面以外の情報と小さな配列のコピー  //
+////////////////////////////////////////
+static void
+CopyGameState( game_info_t *dst, const game_info_t *src )
+{
+  memcpy(dst->prisoner,           src->prisoner,           sizeof(int) * S_MAX);
+  memcpy(dst->board,              src->board,              sizeof(char) * board_max);  
+  memcpy(dst->candidates,         src->candidates,         sizeof(bool) * board_max); 
+  memcpy(dst->capture_num,        src->capture_num,        sizeof(int) * S_OB);
+  memcpy(dst->update_num,         src->update_num,         sizeof(int) * S_OB);
+
+  fill_n(dst->tactical_features1, board_max, 0);
+  fill_n(dst->tactical_features2, board_max, 0);
+
   dst->current_hash = src->current_hash;
   dst->previous1_hash = src->previous1_hash;
   dst->previous2_hash = src->previous2_hash;
@@ -401,6 +572,207 @@ CopyGame( game_info_t *dst, const game_info_t *src )
 }
 
 
+//////////////////////////
+//  着手の記録の開始    //
+//////////////////////////
+void
+BeginUndo( game_info_t *game )
+{
+  if (undo_journal.game != nullptr && undo_journal.game != game) {
+    cerr << "BeginUndo : another game is recorded in this thread" << endl;
+    abort();
+  }
+
+  undo_journal.game = game;
+  game->undo_depth++;
+}
+
+
+//////////////////////////
+//  着手の記録の終了    //
+//////////////////////////
+void
+EndUndo( game_info_t *game )
+{
+  if (--game->undo_depth == 0) {
+    undo_journal.game = nullptr;
+    undo_journal.frame.clear();
+    undo_journal.pos.clear();
+    undo_journal.string.clear();
+  }
+}
+
+
+////////////////////////////////
+//  1手分の記録を始める       //
+////////////////////////////////
+static void
+PushUndoFrame( game_info_t *game, const int pos, const int color )
+{
+  undo_journal.frame.emplace_back();
+  undo_frame_t &frame = undo_journal.frame.back();
+
+  frame.pos = pos;
+  frame.color = color;
+  frame.moves = game->moves;
+  frame.ko_pos = game->ko_pos;
+  frame.ko_move = game->ko_move;
+  frame.pass_count = game->pass_count;
+  memcpy(frame.prisoner, game->prisoner, sizeof(int) * S_MAX);
+  frame.capture_num = game->capture_num[color];
+  frame.superko_num = game->superko_num;
+  frame.current_hash = game->current_hash;
+  frame.previous1_hash = game->previous1_hash;
+  frame.previous2_hash = game->previous2_hash;
+  frame.positional_hash = game->positional_hash;
+  frame.move_hash = game->move_hash;
+  frame.tactical_features1 = game->tactical_features1[pos];
+  frame.tactical_features2 = game->tactical_features2[pos];
+  frame.pos_begin = undo_journal.pos.size();
+  frame.string_begin = undo_journal.string.size();
+  frame.saved_pos.Clear();
+  frame.saved_string.Clear();
+}
+
+
+////////////////////////////////
+//  変更前の座標の情報を記録  //
+////////////////////////////////
+static void
+SavePos( game_info_t *game, const int pos )
+{
+  undo_frame_t &frame = undo_journal.frame.back();
+
+  if (frame.saved_pos.Has(pos)) return;
+  frame.saved_pos.Add(pos);
+
+  undo_journal.pos.push_back({ pos, game->string_id[pos], game->string_next[pos],
+			       game->board[pos], game->candidates[pos] });
+}
+
+
+//////////////////////////
+//  変更前の連を記録    //
+//////////////////////////
+static void
+SaveString( game_info_t *game, const int id )
+{
+  undo_frame_t &frame = undo_journal.frame.back();
+
+  if (frame.saved_string.Has(id)) return;
+  frame.saved_string.Add(id);
+
+  undo_journal.string.push_back({ id, game->string[id] });
+}
+
+
+////////////////
+//  1手戻す  //
+////////////////
+void
+Undo( game_info_t *game )
+{
+  if (game->undo_depth == 0 || undo_journal.frame.empty()) {
+    cerr << "Undo : no move is recorded" << endl;
+    abort();
+  }
+
+  const undo_frame_t &frame = undo_journal.frame.back();
+
+  // 連を戻す
+  for (size_t i = frame.string_begin; i < undo_journal.string.size(); i++) {
+    const undo_string_t &rec = undo_journal.string[i];
+    game->string[rec.id] = rec.string;
+  }
+
+  // 座標を戻す
+  // パターンは石を置いた, または取り除いた差分を逆に更新する
+  for (size_t i = frame.pos_begin; i < undo_journal.pos.size(); i++) {
+    const undo_pos_t &rec = undo_journal.pos[i];
+    const int pos = rec.pos;
+    if (game->board[pos] != rec.board) {
+      if (rec.board == S_EMPTY) {
+	UpdatePatternEmpty(game->pat, pos);
+      } else {
+	UpdatePatternStone(game->pat, rec.board, pos);
+      }
+    }
+    game->board[pos] = rec.board;
+    game->string_id[pos] = rec.string_id;
+    game->string_next[pos] = rec.string_next;
+    game->candidates[pos] = rec.candidates;
+  }
+
+  game->moves = frame.moves;
+  game->ko_pos = frame.ko_pos;
+  game->ko_move = frame.ko_move;
+  game->pass_count = frame.pass_count;
+  memcpy(game->prisoner, frame.prisoner, sizeof(int) * S_MAX);
+  game->capture_num[frame.color] = frame.capture_num;
+  game->current_hash = frame.current_hash;
+  game->previous1_hash = frame.previous1_hash;
+  game->previous2_hash = frame.previous2_hash;
+  game->positional_hash = frame.positional_hash;
+  game->move_hash = frame.move_hash;
+  game->tactical_features1[frame.pos] = frame.tactical_features1;
+  game->tactical_features2[frame.pos] = frame.tactical_features2;
+  TruncateSuperKoHash(game, frame.superko_num);
+
+  undo_journal.pos.resize(frame.pos_begin);
+  undo_journal.string.resize(frame.string_begin);
+  undo_journal.frame.pop_back();
+}
+
+
+//////////////////////////////////////////////
+//  超劫の確認用の局面の集合 (線形探査)     //
+//////////////////////////////////////////////
+static bool
+HasSuperKoHash( const game_info_t *game, const unsigned long long hash )
+{
+  int i = (int)(hash & (SUPERKO_HASH_SIZE - 1));
+
+  while (game->superko_hash[i] != 0) {
+    if (game->superko_hash[i] == hash) {
+      return true;
+    }
+    i = (i + 1) & (SUPERKO_HASH_SIZE - 1);
+  }
+
+  return false;
+}
+
+
+static void
+AddSuperKoHash( game_info_t *game, const unsigned long long hash )
+{
+  int i = (int)(hash & (SUPERKO_HASH_SIZE - 1));
+
+  // 0は空きを表すので加えない(空の盤面)
+  if (hash == 0) return;
+
+  while (game->superko_hash[i] != 0) {
+    if (game->superko_hash[i] == hash) {
+      return;
+    }
+    i = (i + 1) & (SUPERKO_HASH_SIZE - 1);
+  }
+
+  game->superko_hash[i] = hash;
+  game->superko_slot[game->superko_num++] = i;
+}
+
+
+// 後から加えたものから取り除くので, 残りの要素の探査は変わらない
+static void
+TruncateSuperKoHash( game_info_t *game, const int num )
+{
+  while (game->superko_num > num) {
+    game->superko_hash[game->superko_slot[--game->superko_num]] = 0;
+  }
+}
+
+
 
 ////////////////////
 //  定数の初期化  //
@@ -415,8 +787,10 @@ InitializeConst( void )
   komi[S_WHITE] = default_komi - 1.0;
 
   i = 0;
+  fill_n(pure_board_index, BOARD_MAX, -1);
   for (int y = board_start; y <= board_end; y++) {
     for (int x = board_start; x <= board_end; x++) {
+      pure_board_index[POS(x, y)] = i;
       onboard_pos[i++] = POS(x, y);
       board_x[POS(x, y)] = x;
       board_y[POS(x, y)] = y;
@@ -840,10 +1214,8 @@ IsLegal( const game_info_t *game, const int pos, const int color )
     // posにcolorを置いたと仮定
     hash ^= hash_bit[pos][color];
     
-    for (int i = 0; i < game->moves; i++) {
-      if (game->record[i].hash == hash) {
-	return false;
-      }
+    if (HasSuperKoHash(game, hash)) {
+      return false;
     }
   }
 
@@ -1207,6 +1579,11 @@ PutStone( game_info_t *game, const int pos, const int color )
   int prisoner = 0;
   int neighbor[4];
 
+  // 戻すための記録
+  if (game->undo_depth > 0) {
+    PushUndoFrame(game, pos, color);
+  }
+
   // この手番の着手で打ち上げた石の数を0にする
   game->capture_num[color] = 0;
 
@@ -1225,13 +1602,16 @@ PutStone( game_info_t *game, const int pos, const int color )
   if (game->moves < MAX_RECORDS) {
     game->record[game->moves].color = color;
     game->record[game->moves].pos = pos;
-    game->move_hash ^= move_bit[game->moves][pos][color];
+    game->move_hash ^= MoveBit(game->moves, pos, color);
   }
 
   // 着手がパスなら手数を進めて終了
   if (pos == PASS) {
     if (game->moves < MAX_RECORDS) {
       game->record[game->moves].hash = game->positional_hash;
+      if (check_superko) {
+	AddSuperKoHash(game, game->positional_hash);
+      }
     }
     game->current_hash ^= hash_bit[game->pass_count++][HASH_PASS];
     if (game->pass_count >= BOARD_MAX) { 
@@ -1242,6 +1622,7 @@ PutStone( game_info_t *game, const int pos, const int color )
   }
 
   // 石を置く
+  TouchPos(game, pos);
   board[pos] = (char)color;
 
   // 候補手から除外
@@ -1260,6 +1641,9 @@ PutStone( game_info_t *game, const int pos, const int color )
   // 自分の連があれば, その連の呼吸点を1つ減らし, 接続候補に入れる
   // 敵の連であれば, その連の呼吸点を1つ減らし, 呼吸点が0になったら取り除く
   for (int i = 0; i < 4; i++) {
+    if (board[neighbor[i]] == color || board[neighbor[i]] == other) {
+      TouchString(game, string_id[neighbor[i]]);
+    }
     if (board[neighbor[i]] == color) {
       RemoveLiberty(game, &string[string_id[neighbor[i]]], pos);
       connect[connection++] = string_id[neighbor[i]];
@@ -1294,6 +1678,9 @@ PutStone( game_info_t *game, const int pos, const int color )
   // ハッシュ値の記録
   if (game->moves < MAX_RECORDS) {
     game->record[game->moves].hash = game->positional_hash;
+    if (check_superko) {
+      AddSuperKoHash(game, game->positional_hash);
+    }
   }
 
   // 手数を1つだけ進める
@@ -1332,6 +1719,7 @@ PoPutStone( game_info_t *game, const int pos, const int color )
   }
 
   // 碁盤に石を置く
+  TouchPos(game, pos);
   board[pos] = (char)color;
 
   // 候補酒から除外
@@ -1342,11 +1730,9 @@ PoPutStone( game_info_t *game, const int pos, const int color )
   game->tactical_features2[pos] = 0;
 
   // 着手箇所のレートを0に戻す
-  game->sum_rate[0] -= game->rate[0][pos];
-  game->sum_rate_row[0][board_y[pos]] -= game->rate[0][pos];
+  UpdateRateSum(&game->sum_rate[0], game->sum_rate_row[0], pos, -game->rate[0][pos]);
   game->rate[0][pos] = 0;
-  game->sum_rate[1] -= game->rate[1][pos];
-  game->sum_rate_row[1][board_y[pos]] -= game->rate[1][pos];
+  UpdateRateSum(&game->sum_rate[1], game->sum_rate_row[1], pos, -game->rate[1][pos]);
   game->rate[1][pos] = 0;
 
   // パターンの更新(MD2)  
@@ -1359,6 +1745,9 @@ PoPutStone( game_info_t *game, const int pos, const int color )
   // 自分の連があれば, その連の呼吸点を1つ減らし, 接続候補に入れる
   // 敵の連であれば, その連の呼吸点を1つ減らし, 呼吸点が0になったら取り除く  
   for (int i = 0; i < 4; i++) {
+    if (board[neighbor[i]] == color || board[neighbor[i]] == other) {
+      TouchString(game, string_id[neighbor[i]]);
+    }
     if (board[neighbor[i]] == color) {
       PoRemoveLiberty(game, &string[string_id[neighbor[i]]], pos, color);
       connect[connection++] = string_id[neighbor[i]];
@@ -1405,7 +1794,6 @@ MakeString( game_info_t *game, const int pos, const int color )
   string_t *new_string;
   int *string_id = game->string_id;
   int id = 1;
-  int lib_add = 0;
   int other = FLIP_COLOR(color);
   int neighbor, neighbor4[4], i;
 
@@ -1414,12 +1802,11 @@ MakeString( game_info_t *game, const int pos, const int color )
 
   // 新しく連のデータを格納する箇所を保持
   new_string = &game->string[id];
+  TouchString(game, id);
 
   // 連のデータの初期化
-  fill_n(new_string->lib, STRING_LIB_MAX, 0);
-  fill_n(new_string->neighbor, MAX_NEIGHBOR, 0);
-  new_string->lib[0] = LIBERTY_END;
-  new_string->neighbor[0] = NEIGHBOR_END;
+  new_string->lib.Clear();
+  new_string->neighbor.Clear();
   new_string->libs = 0;
   new_string->color = (char)color;
   new_string->origin = pos;
@@ -1436,11 +1823,11 @@ MakeString( game_info_t *game, const int pos, const int color )
   // 敵の連ならば, 隣接する連をお互いに追加する
   for (i = 0; i < 4; i++) {
     if (board[neighbor4[i]] == S_EMPTY) {
-      lib_add = AddLiberty(new_string, neighbor4[i], lib_add);
+      AddLiberty(new_string, neighbor4[i]);
     } else if (board[neighbor4[i]] == other) {
       neighbor = string_id[neighbor4[i]];
-      AddNeighbor(&string[neighbor], id, 0);
-      AddNeighbor(&string[id], neighbor, 0);
+      AddNeighbor(&string[neighbor], id);
+      AddNeighbor(&string[id], neighbor);
     }
   }
 
@@ -1464,6 +1851,8 @@ AddStoneToString( game_info_t *game, string_t *string, const int pos, const int
 
   if (pos == STRING_END) return;
 
+  TouchPos(game, pos);
+
   // 追加先の連の先頭の前ならば先頭に追加
   // そうでなければ挿入位置を探し出し追加
   if (string->origin > pos) {
@@ -1482,6 +1871,7 @@ AddStoneToString( game_info_t *game, string_t *string, const int pos, const int
       }
       str_pos = string_next[str_pos];
     }
+    TouchPos(game, str_pos);
     string_next[pos] = string_next[str_pos];
     string_next[str_pos] = pos;
   }
@@ -1504,7 +1894,6 @@ AddStone( game_info_t *game, const int pos, const int color, const int id )
   string_t *add_str;
   char *board = game->board;
   int *string_id = game->string_id;
-  int lib_add = 0;
   int neighbor, neighbor4[4];
 
   // IDを更新
@@ -1523,11 +1912,11 @@ AddStone( game_info_t *game, const int pos, const int color, const int id )
   // 敵の石があれば隣接する敵連の情報を更新
   for (int i = 0; i < 4; i++) {
     if (board[neighbor4[i]] == S_EMPTY) {
-      lib_add = AddLiberty(add_str, neighbor4[i], lib_add);
+      AddLiberty(add_str, neighbor4[i]);
     } else if (board[neighbor4[i]] == other) {
       neighbor = string_id[neighbor4[i]];
-      AddNeighbor(&string[neighbor], id, 0);
-      AddNeighbor(&string[id], neighbor, 0);
+      AddNeighbor(&string[neighbor], id);
+      AddNeighbor(&string[id], neighbor);
     }
   }
 }
@@ -1601,17 +1990,14 @@ MergeString( game_info_t *game, string_t *dst, string_t *src[3], const int n )
     rm_id = string_id[src[i]->origin];
 
     // 呼吸点をマージ
-    prev = 0;
-    pos = src[i]->lib[0];
-    while (pos != LIBERTY_END) {
-      prev = AddLiberty(dst, pos, prev);
-      pos = src[i]->lib[pos];
-    }
+    dst->lib.Merge(src[i]->lib);
+    dst->libs = dst->lib.Count();
 
     // 連のIDを更新
     prev = 0;
     pos = src[i]->origin;
     while (pos != STRING_END) {
+      TouchPos(game, pos);
       string_id[pos] = id;
       tmp = string_next[pos];
       AddStoneToString(game, dst, pos, prev);
@@ -1620,13 +2006,12 @@ MergeString( game_info_t *game, string_t *dst, string_t *src[3], const int n )
     }
 
     // 隣接する敵連の情報をマージ
-    prev = 0;
     neighbor = src[i]->neighbor[0];
     while (neighbor != NEIGHBOR_END) {
+      TouchString(game, neighbor);
       RemoveNeighborString(&string[neighbor], rm_id);
-      AddNeighbor(dst, neighbor, prev);
-      AddNeighbor(&string[neighbor], id, prev);
-      prev = neighbor;
+      AddNeighbor(dst, neighbor);
+      AddNeighbor(&string[neighbor], id);
       neighbor = src[i]->neighbor[neighbor];
     }
 
@@ -1639,34 +2024,19 @@ MergeString( game_info_t *game, string_t *dst, string_t *src[3], const int n )
 ////////////////////
 //  呼吸点の追加  //
 ////////////////////
-static int
-AddLiberty( string_t *string, const int pos, const int head )
+static void
+AddLiberty( string_t *string, const int pos )
 // string_t *string : 呼吸点を追加する対象の連
 // int pos        : 追加する呼吸点の座標
-// int head       : 探索対象の先頭のインデックス
 {
-  int lib;
-
   // 既に追加されている場合は何もしない
-  if (string->lib[pos] != 0) return pos;
-
-  // 探索対象の先頭のインデックスを代入
-  lib = head;
-
-  // 追加する場所を見つけるまで進める
-  while (string->lib[lib] < pos) {
-    lib = string->lib[lib];
-  }
+  if (string->lib.Has(pos)) return;
 
   // 呼吸点の座標を追加する
-  string->lib[pos] = string->lib[lib];
-  string->lib[lib] = (short)pos;
+  string->lib.Add(pos);
 
   // 呼吸点の数を1つ増やす
   string->libs++;
-
-  // 追加した呼吸点の座標を返す
-  return pos;
 }
 
 
@@ -1679,25 +2049,18 @@ RemoveLiberty( game_info_t *game, string_t *string, const int pos )
 // string_t *string  : 呼吸点を取り除く対象の連
 // int pos         : 取り除かれる呼吸点
 {
-  int lib = 0;
-
   // 既に取り除かれている場合は何もしない
-  if (string->lib[pos] == 0) return;
-
-  // 取り除く呼吸点の座標を見つけるまで進める
-  while (string->lib[lib] != pos) {
-    lib = string->lib[lib];
-  }
+  if (!string->lib.Has(pos)) return;
 
   // 呼吸点の座標の情報を取り除く
-  string->lib[lib] = string->lib[string->lib[lib]];
-  string->lib[pos] = (short)0;
+  string->lib.Remove(pos);
 
   // 連の呼吸点の数を1つ減らす
   string->libs--;
 
   // 呼吸点が1つならば, その連の呼吸点を候補手に追加
   if (string->libs == 1) {
+    if (game->undo_depth > 0) SavePos(game, string->lib[0]);
     game->candidates[string->lib[0]] = true;
   }
 }
@@ -1714,19 +2077,11 @@ PoRemoveLiberty( game_info_t *game, string_t *string, const int pos, const int c
 // int pos         : 取り除かれる呼吸点
 // int color       : その手番の色
 {
-  int lib = 0;
-
   // 既に取り除かれている場合は何もしない
-  if (string->lib[pos] == 0) return;
-
-  // 取り除く呼吸点の座標を見つけるまで進める
-  while (string->lib[lib] != pos) {
-    lib = string->lib[lib];
-  }
+  if (!string->lib.Has(pos)) return;
 
   // 呼吸点の座標の情報を取り除く
-  string->lib[lib] = string->lib[string->lib[lib]];
-  string->lib[pos] = 0;
+  string->lib.Remove(pos);
 
   // 呼吸点の数を1つ減らす
   string->libs--;
@@ -1759,7 +2114,16 @@ RemoveString( game_info_t *game, string_t *string )
   int neighbor, rm_id = string_id[string->origin];
   int removed_color = board[pos];
 
+  // 呼吸点と隣接情報が変わる連を記録
+  neighbor = string->neighbor[0];
+  while (neighbor != NEIGHBOR_END) {
+    TouchString(game, neighbor);
+    neighbor = string->neighbor[neighbor];
+  }
+
   do {
+    TouchPos(game, pos);
+
     // 空点に戻す
     board[pos] = S_EMPTY;
 
@@ -1774,10 +2138,10 @@ RemoveString( game_info_t *game, string_t *string )
 
     // 上下左右を確認する
     // 隣接する連があれば呼吸点を追加する
-    if (str[string_id[NORTH(pos)]].flag) AddLiberty(&str[string_id[NORTH(pos)]], pos, 0);
-    if (str[string_id[ WEST(pos)]].flag) AddLiberty(&str[string_id[ WEST(pos)]], pos, 0);
-    if (str[string_id[ EAST(pos)]].flag) AddLiberty(&str[string_id[ EAST(pos)]], pos, 0);
-    if (str[string_id[SOUTH(pos)]].flag) AddLiberty(&str[string_id[SOUTH(pos)]], pos, 0);
+    if (str[string_id[NORTH(pos)]].flag) AddLiberty(&str[string_id[NORTH(pos)]], pos);
+    if (str[string_id[ WEST(pos)]].flag) AddLiberty(&str[string_id[ WEST(pos)]], pos);
+    if (str[string_id[ EAST(pos)]].flag) AddLiberty(&str[string_id[ EAST(pos)]], pos);
+    if (str[string_id[SOUTH(pos)]].flag) AddLiberty(&str[string_id[SOUTH(pos)]], pos);
 
     // 連を構成する次の石の座標を記録
     next = string_next[pos];
@@ -1831,6 +2195,7 @@ PoRemoveString( game_info_t *game, string_t *string, const int color )
   // 隣接する連の呼吸点を更新の対象に加える
   neighbor = string->neighbor[0];
   while (neighbor != NEIGHBOR_END) {
+    TouchString(game, neighbor);
     if (str[neighbor].libs < 3) {
       lib = str[neighbor].lib[0];
       while (lib != LIBERTY_END) {
@@ -1843,6 +2208,8 @@ PoRemoveString( game_info_t *game, string_t *string, const int color )
   }
   
   do {
+    TouchPos(game, pos);
+
     // 空点に戻す
     board[pos] = S_EMPTY;
     // 候補手に追加する
@@ -1856,10 +2223,10 @@ PoRemoveString( game_info_t *game, string_t *string, const int color )
     
     // 上下左右を確認する
     // 隣接する連があれば呼吸点を追加する
-    if (str[string_id[NORTH(pos)]].flag) AddLiberty(&str[string_id[NORTH(pos)]], pos, 0);
-    if (str[string_id[ WEST(pos)]].flag) AddLiberty(&str[string_id[ WEST(pos)]], pos, 0);
-    if (str[string_id[ EAST(pos)]].flag) AddLiberty(&str[string_id[ EAST(pos)]], pos, 0);
-    if (str[string_id[SOUTH(pos)]].flag) AddLiberty(&str[string_id[SOUTH(pos)]], pos, 0);
+    if (str[string_id[NORTH(pos)]].flag) AddLiberty(&str[string_id[NORTH(pos)]], pos);
+    if (str[string_id[ WEST(pos)]].flag) AddLiberty(&str[string_id[ WEST(pos)]], pos);
+    if (str[string_id[ EAST(pos)]].flag) AddLiberty(&str[string_id[ EAST(pos)]], pos);
+    if (str[string_id[SOUTH(pos)]].flag) AddLiberty(&str[string_id[SOUTH(pos)]], pos);
 
     // 連を構成する次の石の座標を記録
     next = string_next[pos];
@@ -1892,27 +2259,15 @@ PoRemoveString( game_info_t *game, string_t *string, const int color )
 //  隣接する連IDの追加(重複確認)  //
 ////////////////////////////////////
 static void
-AddNeighbor( string_t *string, const int id, const int head )
+AddNeighbor( string_t *string, const int id )
 // string_t *string : 隣接情報を追加する連
 // int id         : 追加される連ID
-// int head       : 探索対象の先頭のインデックス
 {
-  int neighbor = 0;
-
   // 既に追加されている場合は何もしない
-  if (string->neighbor[id] != 0) return;
-
-  // 探索対象の先頭のインデックスを代入
-  neighbor = head;
-
-  // 追加場所を見つけるまで進める
-  while (string->neighbor[neighbor] < id) {
-    neighbor = string->neighbor[neighbor];
-  }
+  if (string->neighbor.Has(id)) return;
 
   // 隣接する連IDを追加する
-  string->neighbor[id] = string->neighbor[neighbor];
-  string->neighbor[neighbor] = (short)id;
+  string->neighbor.Add(id);
 
   // 隣接する連の数を1つ増やす
   string->neighbors++;
@@ -1927,19 +2282,11 @@ RemoveNeighborString( string_t *string, const int id )
 // string_t *string : 隣接する連のIDを取り除く対象の連
 // int id         : 取り除く連のID
 {
-  int neighbor = 0;
-
   // 既に除外されていれば何もしない
-  if (string->neighbor[id] == 0) return;
-
-  // 取り除く隣接する連IDを見つけるまで進める
-  while (string->neighbor[neighbor] != id) {
-    neighbor = string->neighbor[neighbor];
-  }
+  if (!string->neighbor.Has(id)) return;
 
   // 隣接する連IDを取り除く
-  string->neighbor[neighbor] = string->neighbor[string->neighbor[neighbor]];
-  string->neighbor[id] = 0;
+  string->neighbor.Remove(id);
 
   // 隣接する連の数を1つ減らす
   string->neighbors--;
@@ -2102,7 +2449,7 @@ WritePlanes(
   std::vector<float>& data_features,
   std::vector<float>& data_move,
   std::vector<float>* data_owner,
-  const game_info_t *game,
+  game_info_t *game,
   const uct_node_t *root,
   int color,
   int tran)
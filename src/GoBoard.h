@@ -2,13 +2,20 @@
 #define _GO_BOARD_H_
 
 #include <vector>
+#if defined (_MSC_VER)
+#include <intrin.h>
+#endif
 #include "Pattern.h"
 
 ////////////////
 //    定数    //
 ////////////////
 
+#if defined (FIXED_BOARD_SIZE)
+const int PURE_BOARD_SIZE = FIXED_BOARD_SIZE;  // 盤の大きさ(固定)
+#else
 const int PURE_BOARD_SIZE = 19;  // 盤の大きさ
+#endif
 
 const int OB_SIZE = 5; // 盤外の幅
 const int BOARD_SIZE = (PURE_BOARD_SIZE + OB_SIZE + OB_SIZE); // 盤外を含めた盤の幅
@@ -29,7 +36,16 @@ const int STRING_END = (STRING_POS_MAX - 1); // 連の終端を表す値
 const int NEIGHBOR_END = (MAX_NEIGHBOR - 1);  // 隣接する敵連の終端を表す値
 const int LIBERTY_END = (STRING_LIB_MAX - 1); // 呼吸点の終端を表す値
 
+const int LIB_WORDS = ((PURE_BOARD_MAX + 63) / 64);      // 呼吸点の集合の64bit語数 (19x19 : 6)
+const int NEIGHBOR_WORDS = ((MAX_NEIGHBOR + 63) / 64);   // 隣接する敵連の集合の64bit語数 (19x19 : 5)
+
 const int MAX_RECORDS = (PURE_BOARD_MAX * 3); // 記録する着手の最大数 
+const int UPDATE_POS_MAX = (PURE_BOARD_MAX * 4);   // 戦術的特徴の更新対象の最大数(重複を含む)
+
+// n以上の最小の2のべき乗
+constexpr int CeilPow2( const int n, const int p = 1 ) { return p >= n ? p : CeilPow2(n, p * 2); }
+
+const int SUPERKO_HASH_SIZE = CeilPow2(MAX_RECORDS * 3 / 2);  // 超劫の確認に使う局面の集合の大きさ (19x19 : 2048)
 const int MAX_MOVES = (MAX_RECORDS - 1);      // 着手数の最大値
 
 const int PASS = 0;     // パスに相当する値
@@ -88,13 +104,60 @@ struct record_t {
   unsigned long long hash;  // 局面のハッシュ値
 };
 
-// 連を表す構造体 (19x19 : 1987bytes)
+// ビット集合
+template <int WORDS>
+struct bit_set_t {
+  unsigned long long word[WORDS];
+
+  void Clear( void ) {
+    for (int i = 0; i < WORDS; i++) word[i] = 0;
+  }
+  bool Test( const int i ) const { return ((word[i >> 6] >> (i & 63)) & 1) != 0; }
+  void Set( const int i ) { word[i >> 6] |= 1ULL << (i & 63); }
+  void Reset( const int i ) { word[i >> 6] &= ~(1ULL << (i & 63)); }
+
+  // iより後ろで最初に立っているビットの位置(なければ-1)
+  int Next( const int i ) const;
+
+  // 最後に立っているビットの位置(なければ-1)
+  int Last( void ) const;
+
+  // 立っているビットの数
+  int Count( void ) const;
+
+  // 和集合 (語毎のORなのでSIMD化される)
+  void Merge( const bit_set_t &other ) {
+    for (int i = 0; i < WORDS; i++) word[i] |= other.word[i];
+  }
+};
+
+// 連の呼吸点の集合 (盤外を除いた座標の番号のビット集合)
+// 連結リストの時と同じく, lib[0]で先頭の呼吸点, lib[pos]でposの次の呼吸点
+// (最後ならLIBERTY_END)を返し, posが呼吸点でなければ0を返す
+struct liberty_set_t : bit_set_t<LIB_WORDS> {
+  int operator[]( const int pos ) const;
+  bool Has( const int pos ) const;
+  void Add( const int pos );
+  void Remove( const int pos );
+};
+
+// 隣接する敵連の集合 (連番号のビット集合)
+// neighbor[0]で先頭の連番号, neighbor[id]でidの次の連番号
+// (最後ならNEIGHBOR_END)を返し, idが含まれなければ0を返す
+struct neighbor_set_t : bit_set_t<NEIGHBOR_WORDS> {
+  int operator[]( const int id ) const;
+  bool Has( const int id ) const { return Test(id); }
+  void Add( const int id ) { Set(id); }
+  void Remove( const int id ) { Reset(id); }
+};
+
+// 連を表す構造体 (19x19 : 112bytes)
 struct string_t {
   char color;                    // 連の色
   int libs;                      // 連の持つ呼吸点数
-  short lib[STRING_LIB_MAX];     // 連の持つ呼吸点の座標
+  liberty_set_t lib;             // 連の持つ呼吸点の座標
   int neighbors;                 // 隣接する敵の連の数
-  short neighbor[MAX_NEIGHBOR];  // 隣接する敵の連の連番号
+  neighbor_set_t neighbor;       // 隣接する敵の連の連番号
   int origin;                    // 連の始点の座標
   int size;                      // 連を構成する石の数
   bool flag;                     // 連の存在フラグ
@@ -121,10 +184,19 @@ struct game_info_t {
 
   pattern_t pat[BOARD_MAX];    // 周囲の石の配置 
 
-  string_t string[MAX_STRING];        // 連のデータ(19x19 : 573,845bytes)
+  string_t string[MAX_STRING];        // 連のデータ(19x19 : 32,256bytes)
   int string_id[STRING_POS_MAX];    // 各座標の連のID
   int string_next[STRING_POS_MAX];  // 連を構成する石のデータ構造
 
+  liberty_set_t dirty_pos;          // CopyGameの後に連IDか連の構成が変わった座標
+  neighbor_set_t dirty_string;      // CopyGameの後に変更された連
+
+  int undo_depth;                   // BeginUndoの入れ子の深さ (0なら着手を記録しない)
+
+  unsigned long long superko_hash[SUPERKO_HASH_SIZE];  // 現れた局面のハッシュ値の集合 (超劫の確認時のみ, 0は空き)
+  int superko_slot[MAX_RECORDS];    // 集合に加えた位置(加えた順)
+  int superko_num;                  // 集合に加えた局面の数
+
   bool candidates[BOARD_MAX];  // 候補手かどうかのフラグ 
   bool seki[BOARD_MAX];
   
@@ -135,7 +207,7 @@ struct game_info_t {
   int capture_pos[S_OB][PURE_BOARD_MAX];   // 前の着手で石を打ち上げた座標 
 
   int update_num[S_OB];                    // 戦術的特徴が更新された数
-  int update_pos[S_OB][PURE_BOARD_MAX];    // 戦術的特徴が更新された座標 
+  int update_pos[S_OB][UPDATE_POS_MAX];    // 戦術的特徴が更新された座標 
 
   long long rate[2][BOARD_MAX];           // シミュレーション時の各座標のレート 
   long long sum_rate_row[2][BOARD_SIZE];  // シミュレーション時の各列のレートの合計値  
@@ -147,6 +219,16 @@ struct game_info_t {
 //    変数    //
 ////////////////
 
+#if defined (FIXED_BOARD_SIZE)
+// 盤の大きさを固定した時は定数にして,
+// 座標の計算をコンパイル時に済ませる
+const int pure_board_size = PURE_BOARD_SIZE;
+const int pure_board_max = PURE_BOARD_MAX;
+const int board_size = BOARD_SIZE;
+const int board_max = BOARD_MAX;
+const int board_start = BOARD_START;
+const int board_end = BOARD_END;
+#else
 // 碁盤の大きさ
 extern int pure_board_size;
 
@@ -164,6 +246,7 @@ extern int board_start;
 
 // 碁盤の左端(下端)
 extern int board_end;
+#endif
 
 // 初手の候補手の個数
 extern int first_move_candidates;
@@ -207,6 +290,9 @@ extern int move_dis[PURE_BOARD_SIZE][PURE_BOARD_SIZE];
 // 盤上の位置からデータ上の位置の対応
 extern int onboard_pos[PURE_BOARD_MAX];
 
+// データ上の位置から盤上の位置の対応 (盤外は-1)
+extern int pure_board_index[BOARD_MAX];
+
 // 初手の候補手
 extern int first_move_candidate[PURE_BOARD_MAX];
 
@@ -229,6 +315,22 @@ void FreeGame( game_info_t *game );
 // 盤面情報のコピー
 void CopyGame( game_info_t *dst, const game_info_t *src );
 
+// コピー元の局面に戻す
+// (dstはsrcをCopyGameしてから石を置いただけで, srcは変わっていない事)
+void RestoreGame( game_info_t *dst, const game_info_t *src );
+
+// 試しに石を置くために着手の記録を始める
+// 盤面そのものに石を置くので, PutStoneで置いた石をUndoで全て戻してから
+// EndUndoを呼ぶ事 (その間は他のスレッドと共有しない事)
+// PoPutStoneは記録しないので戻せない
+void BeginUndo( game_info_t *game );
+
+// 着手の記録を終える
+void EndUndo( game_info_t *game );
+
+// 最後にPutStoneで置いた石を取り除き, 1手前の局面に戻す
+void Undo( game_info_t *game );
+
 // 定数の初期化
 void InitializeConst( void );
 
@@ -276,7 +378,7 @@ struct uct_node_t;
 
 void WritePlanes(std::vector<float>& data_basic, std::vector<float>& data_features,
   std::vector<float>& data_move, std::vector<float>* data_owner,
-  const game_info_t *game, const uct_node_t *root,
+  game_info_t *game, const uct_node_t *root,
   int color, int tran);
 
 int TransformMove(int p, int i);
@@ -297,4 +399,95 @@ inline int PureBoardPos(int pos) {
   return x + y * pure_board_size;
 }
 
+//  レートをdiffだけ変えて, 全体と列の合計値に反映する
+inline void UpdateRateSum( long long *sum_rate, long long *sum_rate_row, const int pos, const long long diff ) {
+  if (diff == 0) return;
+  *sum_rate += diff;
+  sum_rate_row[board_y[pos]] += diff;
+}
+
+//  最下位の立っているビットの位置
+inline int LowestBit( const unsigned long long x ) {
+#if defined (_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (int)index;
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+//  最上位の立っているビットの位置
+inline int HighestBit( const unsigned long long x ) {
+#if defined (_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return (int)index;
+#else
+  return 63 - __builtin_clzll(x);
+#endif
+}
+
+//  立っているビットの数
+inline int PopCount( const unsigned long long x ) {
+#if defined (_MSC_VER)
+  return (int)__popcnt64(x);
+#else
+  return __builtin_popcountll(x);
+#endif
+}
+
+template <int WORDS>
+inline int bit_set_t<WORDS>::Next( const int i ) const {
+  int w = (i + 1) >> 6;
+  if (w >= WORDS) return -1;
+  unsigned long long bits = word[w] & (~0ULL << ((i + 1) & 63));
+  while (bits == 0) {
+    if (++w >= WORDS) return -1;
+    bits = word[w];
+  }
+  return (w << 6) + LowestBit(bits);
+}
+
+template <int WORDS>
+inline int bit_set_t<WORDS>::Last( void ) const {
+  for (int w = WORDS - 1; w >= 0; w--) {
+    if (word[w] != 0) return (w << 6) + HighestBit(word[w]);
+  }
+  return -1;
+}
+
+template <int WORDS>
+inline int bit_set_t<WORDS>::Count( void ) const {
+  int count = 0;
+  for (int i = 0; i < WORDS; i++) count += PopCount(word[i]);
+  return count;
+}
+
+inline int liberty_set_t::operator[]( const int pos ) const {
+  const int index = pure_board_index[pos];
+  if (pos != 0 && (index < 0 || !Test(index))) return 0;
+  const int next = Next(index);
+  return next < 0 ? LIBERTY_END : onboard_pos[next];
+}
+
+inline bool liberty_set_t::Has( const int pos ) const {
+  const int index = pure_board_index[pos];
+  return index >= 0 && Test(index);
+}
+
+inline void liberty_set_t::Add( const int pos ) {
+  Set(pure_board_index[pos]);
+}
+
+inline void liberty_set_t::Remove( const int pos ) {
+  Reset(pure_board_index[pos]);
+}
+
+inline int neighbor_set_t::operator[]( const int id ) const {
+  if (id != 0 && !Test(id)) return 0;
+  const int next = Next(id);
+  return next < 0 ? NEIGHBOR_END : next;
+}
+
 #endif
@@ -15,6 +15,7 @@
 #include "Gtp.h"
 #include "GoBoard.h"
 #include "Nakade.h"
+#include "PlayoutStat.h"
 #include "UctSearch.h"
 #include "UctRating.h"
 #include "Message.h"
@@ -116,6 +117,12 @@ static void GTP_ray_param();
 //
 static void GTP_ray_stat();
 //
+static void GTP_ray_eval_stat();
+//
+static void GTP_ray_pattern_bench();
+//
+static void GTP_ray_perf();
+//
 static void GTP_features_planes_file(void);
 //
 static void GTP_features_clear(void);
@@ -159,6 +166,9 @@ const GTP_command_t gtpcmd[] = {
   { "ray-best_sequence", GTP_ray_best_sequence },
   { "ray-param", GTP_ray_param },
   { "ray-stat", GTP_ray_stat },
+  { "ray-eval_stat", GTP_ray_eval_stat },
+  { "ray-pattern_bench", GTP_ray_pattern_bench },
+  { "ray-perf", GTP_ray_perf },
   { "_clear", GTP_features_clear },
   { "_store", GTP_features_store },
   { "_dump", GTP_features_planes_file },
@@ -261,8 +271,16 @@ GTP_boardsize( void )
   snprintf(buf, 1024, " ");
 #endif
 
-  if (pure_board_size != size &&
-      size <= PURE_BOARD_SIZE && size > 0) {
+#if defined (FIXED_BOARD_SIZE)
+  if (size != PURE_BOARD_SIZE) {
+#else
+  if (size > PURE_BOARD_SIZE || size <= 0) {
+#endif
+    GTP_response("unacceptable size", false);
+    return;
+  }
+
+  if (pure_board_size != size) {
     SetBoardSize(size);
     SetParameter();
     SetNeighbor();
@@ -815,6 +833,7 @@ GTP_gogui_analyze_commands()
     "none/Togle Live Best Sequence/ray-toggle_live_best_sequence\n"
     "gfx/Print Best Sequence/ray-best_sequence %m\n"
     "hpstring/Print Moves/ray-stat %m\n"
+    "string/Eval Batch Stat/ray-eval_stat\n"
     "",
     true);
 }
@@ -927,6 +946,93 @@ GTP_ray_param()
   GTP_response(brank, true);
 }
 
+////////////////////////////////
+//  void GTP_ray_eval_stat()  //
+////////////////////////////////
+static void
+GTP_ray_eval_stat()
+{
+  stringstream out;
+  PrintEvalBatchStat(out);
+
+  // 最後の改行はGTP_responseが付ける
+  string response = out.str();
+  if (!response.empty() && response.back() == '\n') {
+    response.pop_back();
+  }
+  GTP_response(response.c_str(), true);
+}
+
+///////////////////////////
+//  void GTP_ray_perf()  //
+///////////////////////////
+static void
+GTP_ray_perf()
+{
+  char *command;
+
+  command = STRTOK(NULL, DELIM, &next_token);
+  if (command != NULL) {
+    CHOMP(command);
+    string arg(command);
+    if (arg == "on") {
+      SetPlayoutStat(true);
+    } else if (arg == "off") {
+      SetPlayoutStat(false);
+    } else if (arg == "clear") {
+      ClearPlayoutStat();
+    } else {
+      GTP_response("ray-perf [on|off|clear]", false);
+      return;
+    }
+    GTP_response(brank, true);
+    return;
+  }
+
+  stringstream out;
+  PrintPlayoutStat(out);
+
+  // 最後の改行はGTP_responseが付ける
+  string response = out.str();
+  if (!response.empty() && response.back() == '\n') {
+    response.pop_back();
+  }
+  GTP_response(response.c_str(), true);
+}
+
+/////////////////////////////////////
+//  void GTP_ray_pattern_bench()   //
+/////////////////////////////////////
+static void
+GTP_ray_pattern_bench()
+{
+  char *command;
+  int games = 100;
+
+  command = STRTOK(NULL, DELIM, &next_token);
+  if (command != NULL) {
+    CHOMP(command);
+    games = atoi(command);
+  }
+  if (games < 1) {
+    GTP_response("ray-pattern_bench [games]", false);
+    return;
+  }
+
+  // 現在の局面の手番からランダムに打つ
+  const int color = game->moves > 1 ? FLIP_COLOR(game->record[game->moves - 1].color) : S_BLACK;
+  long long stones, removals;
+  double stone_ns, removal_ns;
+  BenchmarkPatternUpdate(game, color, games, &stones, &removals, &stone_ns, &removal_ns);
+
+  stringstream out;
+  out << fixed << setprecision(1);
+  out << "stone   : " << stone_ns << " ns/update (" << stones << " moves)" << endl;
+  out << "removal : " << removal_ns << " ns/update (" << removals << " captured stones)";
+
+  GTP_response(out.str().c_str(), true);
+}
+
 ///////////////////////////
 //  void GTP_ray_stat()  //
 ///////////////////////////
@@ -1,29 +1,137 @@
+#include <algorithm>
 #include <iostream>
-#include <memory>
+#include <vector>
 
 #include "Message.h"
 #include "Ladder.h"
-#include "SearchBoard.h"
 #include "Point.h"
+#include "ZobristHash.h"
 
 using namespace std;
 
 #define ALIVE true
 #define DEAD  false
 
+//////////////////////////////////////////////////////////////
+//  シチョウの結果のキャッシュ                              //
+//                                                          //
+//  アタリの連毎に, 読みで調べた点とその周囲(region)と,      //
+//  regionの石の配置とregionに接する連の石と呼吸点から       //
+//  作ったハッシュ値(signature)を覚えておく.                 //
+//  signatureが変わらなければ読みの結果も変わらないので,     //
+//  読み直さずに結果を使う                                  //
+//////////////////////////////////////////////////////////////
+struct ladder_cache_t {
+  int origin;                    // 連の始点
+  int escape;                    // アタリから逃げる点
+  int color;                     // 連の色
+  unsigned long long signature;  // regionの局面のハッシュ値
+  vector<short> region;          // 読みで調べた点とその周囲
+  vector<short> result;          // 助からないシチョウの着手
+};
+
+// キャッシュのエントリ数 (2のべき乗)
+const int LADDER_CACHE_SIZE = 1024;
+
+// 探索のスレッド毎に持つ
+static thread_local vector<ladder_cache_t> ladder_cache;
+
+// 読みで調べた点の記録先 (nullptrなら記録しない)
+static thread_local vector<short> *ladder_touched = nullptr;
+
 // シチョウ探索
-static bool IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, const int turn_color );
+static bool IsLadderCaptured( const int depth, game_info_t *game, const int ren_xy, const int turn_color );
+
+
+//////////////////////////////
+//  読みで調べた点を記録    //
+//////////////////////////////
+static inline void
+Touch( const int pos )
+{
+  if (ladder_touched != nullptr) {
+    ladder_touched->push_back((short)pos);
+  }
+}
+
+
+////////////////////////////////
+//  regionの局面のハッシュ値  //
+////////////////////////////////
+static unsigned long long
+RegionSignature( const game_info_t *game, const vector<short> &region )
+{
+  const char *board = game->board;
+  const string_t *string = game->string;
+  const int *string_id = game->string_id;
+  const int *string_next = game->string_next;
+  bool seen[MAX_STRING] = { false };
+  unsigned long long signature = 0;
+
+  for (const short pos : region) {
+    const int c = board[pos];
+    signature ^= hash_bit[pos][c];
+    if (c != S_BLACK && c != S_WHITE) {
+      continue;
+    }
+    // 接する連の石と呼吸点
+    const int id = string_id[pos];
+    if (seen[id]) {
+      continue;
+    }
+    seen[id] = true;
+    unsigned long long stones = 0, libs = 0;
+    for (int p = string[id].origin; p != STRING_END; p = string_next[p]) {
+      stones ^= hash_bit[p][c];
+    }
+    for (int lib = string[id].lib[0]; lib != LIBERTY_END; lib = string[id].lib[lib]) {
+      libs ^= hash_bit[lib][HASH_KO];
+    }
+    signature ^= stones * 0x9e3779b97f4a7c15ULL + libs;
+  }
+
+  // 接する連が取られた時に呼吸点が増える隣の連
+  for (const short pos : region) {
+    const int c = board[pos];
+    if (c != S_BLACK && c != S_WHITE) {
+      continue;
+    }
+    const int id = string_id[pos];
+    for (int neighbor = string[id].neighbor[0]; neighbor != NEIGHBOR_END; neighbor = string[id].neighbor[neighbor]) {
+      if (seen[neighbor]) {
+	continue;
+      }
+      seen[neighbor] = true;
+      unsigned long long libs = 0;
+      for (int lib = string[neighbor].lib[0]; lib != LIBERTY_END; lib = string[neighbor].lib[lib]) {
+	libs ^= hash_bit[lib][HASH_KO];
+      }
+      signature ^= (hash_bit[string[neighbor].origin][(int)string[neighbor].color] + libs) * 0xc2b2ae3d27d4eb4fULL;
+    }
+  }
+
+  // 劫
+  if (game->ko_move == game->moves - 1) {
+    signature ^= hash_bit[game->ko_pos][HASH_KO] * 3;
+  }
+
+  return signature;
+}
 
 ////////////////////////////////
 //  現在の局面のシチョウ探索  //
 ////////////////////////////////
 void
-LadderExtension( const game_info_t *game, int color, bool *ladder_pos )
+LadderExtension( game_info_t *game, int color, bool *ladder_pos )
 {
   const string_t *string = game->string;
-  std::unique_ptr<search_game_info_t> search_game;
+  bool recording = false;
   bool checked[BOARD_MAX] = { false };
 
+  if (ladder_cache.empty()) {
+    ladder_cache.resize(LADDER_CACHE_SIZE);
+  }
+
   for (int i = 0; i < MAX_STRING; i++) {
     if (!string[i].flag ||
         string[i].size < 2 ||
@@ -37,23 +145,50 @@ LadderExtension( const game_info_t *game, int color, bool *ladder_pos )
 
     // アタリを逃げる手で未探索のものを確認
     if (!checked[ladder] && string[i].libs == 1) {
-      if (!search_game)
-        search_game.reset(new search_game_info_t(game));
-      search_game_info_t *ladder_game = search_game.get();
+      const int origin = string[i].origin;
+      ladder_cache_t &cache = ladder_cache[(origin * 31 + ladder * 2 + color) & (LADDER_CACHE_SIZE - 1)];
+
+      // 前回の読みから変わっていなければ結果を使う
+      if (cache.origin == origin && cache.escape == ladder && cache.color == color &&
+	  cache.signature == RegionSignature(game, cache.region)) {
+	for (const short pos : cache.result) {
+	  ladder_pos[pos] = true;
+	}
+	checked[ladder] = true;
+	continue;
+      }
+
+      cache.origin = origin;
+      cache.escape = ladder;
+      cache.color = color;
+      cache.result.clear();
+      vector<short> touched;
+      ladder_touched = &touched;
+      Touch(origin);
+
+      // 石を置いて読んだ後に元に戻す
+      if (!recording) {
+	BeginUndo(game);
+	recording = true;
+      }
       // 隣接する敵連を取って助かるかを確認
       int neighbor = string[i].neighbor[0];
       while (neighbor != NEIGHBOR_END && !flag) {
+        Touch(string[neighbor].origin);
         if (string[neighbor].libs == 1) {
-          if (IsLegal(game, string[neighbor].lib[0], color)) {
-            PutStoneForSearch(ladder_game, string[neighbor].lib[0], color);
-            if (IsLadderCaptured(0, ladder_game, string[i].origin, FLIP_COLOR(color)) == DEAD) {
+          // 着手すると連の情報が変わるので先に取り出す
+          const int capture = string[neighbor].lib[0];
+          Touch(capture);
+          if (IsLegal(game, capture, color)) {
+            PutStone(game, capture, color);
+            if (IsLadderCaptured(0, game, origin, FLIP_COLOR(color)) == DEAD) {
               if (string[i].size >= 2) {
-                ladder_pos[string[neighbor].lib[0]] = true;
+                cache.result.push_back(capture);
               }
             } else {
               flag = true;
             }
-            Undo(ladder_game);
+            Undo(game);
           }
         }
 	neighbor = string[i].neighbor[neighbor];
@@ -61,18 +196,41 @@ LadderExtension( const game_info_t *game, int color, bool *ladder_pos )
 
       // 取って助からない時は逃げてみる
       if (!flag) {
+	Touch(ladder);
 	if (IsLegal(game, ladder, color)) {
-	  PutStoneForSearch(ladder_game, ladder, color);
+	  PutStone(game, ladder, color);
 	  if (string[i].size >= 2 &&
-	      IsLadderCaptured(0, ladder_game, ladder, FLIP_COLOR(color)) == DEAD) {
-	    ladder_pos[ladder] = true;
+	      IsLadderCaptured(0, game, ladder, FLIP_COLOR(color)) == DEAD) {
+	    cache.result.push_back(ladder);
 	  }
-	  Undo(ladder_game);
+	  Undo(game);
 	}
       }
       checked[ladder] = true;
+
+      // 調べた点とその周囲をregionにする
+      ladder_touched = nullptr;
+      cache.region.clear();
+      for (const short pos : touched) {
+	cache.region.push_back(pos);
+	cache.region.push_back(NORTH(pos));
+	cache.region.push_back(WEST(pos));
+	cache.region.push_back(EAST(pos));
+	cache.region.push_back(SOUTH(pos));
+      }
+      sort(cache.region.begin(), cache.region.end());
+      cache.region.erase(unique(cache.region.begin(), cache.region.end()), cache.region.end());
+      cache.signature = RegionSignature(game, cache.region);
+
+      for (const short pos : cache.result) {
+	ladder_pos[pos] = true;
+      }
     }
   }
+
+  if (recording) {
+    EndUndo(game);
+  }
 }
 
 
@@ -80,7 +238,7 @@ LadderExtension( const game_info_t *game, int color, bool *ladder_pos )
 //  シチョウ探索  //
 ////////////////////
 static bool
-IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, const int turn_color )
+IsLadderCaptured( const int depth, game_info_t *game, const int ren_xy, const int turn_color )
 {
   const char *board = game->board;
   const string_t *string = game->string;
@@ -108,9 +266,11 @@ IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, c
     // 取れるなら取って探索を続ける
     neighbor = string[str].neighbor[0];
     while (neighbor != NEIGHBOR_END) {
+      Touch(string[neighbor].origin);
       if (string[neighbor].libs == 1) {
-	if (IsLegalForSearch(game, string[neighbor].lib[0], escape_color)) {
-	  PutStoneForSearch(game, string[neighbor].lib[0], escape_color);
+	Touch(string[neighbor].lib[0]);
+	if (IsLegal(game, string[neighbor].lib[0], escape_color)) {
+	  PutStone(game, string[neighbor].lib[0], escape_color);
 	  result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
 	  Undo(game);
 	  if (result == ALIVE) {
@@ -124,8 +284,9 @@ IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, c
     // 逃げる手を打ってみて探索を続ける
     escape_xy = string[str].lib[0];
     while (escape_xy != LIBERTY_END) {
-      if (IsLegalForSearch(game, escape_xy, escape_color)) {
-	PutStoneForSearch(game, escape_xy, escape_color);
+      Touch(escape_xy);
+      if (IsLegal(game, escape_xy, escape_color)) {
+	PutStone(game, escape_xy, escape_color);
 	result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
 	Undo(game);
 	if (result == ALIVE) {
@@ -142,8 +303,9 @@ IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, c
     // 追いかける側なのでアタリにする手を打ってみる
     capture_xy = string[str].lib[0];
     while (capture_xy != LIBERTY_END) {
-      if (IsLegalForSearch(game, capture_xy, capture_color)) {
-	PutStoneForSearch(game, capture_xy, capture_color);
+      Touch(capture_xy);
+      if (IsLegal(game, capture_xy, capture_color)) {
+	PutStone(game, capture_xy, capture_color);
 	result = IsLadderCaptured(depth + 1, game, ren_xy, FLIP_COLOR(turn_color));
 	Undo(game);
 	if (result == DEAD) {
@@ -162,7 +324,7 @@ IsLadderCaptured( const int depth, search_game_info_t *game, const int ren_xy, c
 //  助からないシチョウを逃げる手か判定  //
 //////////////////////////////////////////
 bool
-CheckLadderExtension( const game_info_t *game, int color, int pos )
+CheckLadderExtension( game_info_t *game, int color, int pos )
 {
   const char *board = game->board;
   const string_t *string = game->string;
@@ -179,14 +341,15 @@ CheckLadderExtension( const game_info_t *game, int color, int pos )
 
   if (string[id].libs == 1 &&
       IsLegal(game, ladder, color)) {
-    std::unique_ptr<search_game_info_t> search_game(new search_game_info_t(game));
-    search_game_info_t *ladder_game = search_game.get();
-    PutStoneForSearch(ladder_game, ladder, color);
-    if (IsLadderCaptured(0, ladder_game, ladder, FLIP_COLOR(color)) == DEAD) {
+    BeginUndo(game);
+    PutStone(game, ladder, color);
+    if (IsLadderCaptured(0, game, ladder, FLIP_COLOR(color)) == DEAD) {
       flag = true;
     } else {
       flag = false;
     }
+    Undo(game);
+    EndUndo(game);
   }
 
   return flag;
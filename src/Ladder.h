@@ -3,8 +3,10 @@
 
 #include "GoBoard.h"
 
+// どちらも盤面に石を置いて読み, Undoで元に戻す (その間はgameが変わる)
+
 // 全ての連に対して逃げて助かるシチョウかどうか確認
-void LadderExtension( const game_info_t *game, int color, bool *ladder_pos );
+void LadderExtension( game_info_t *game, int color, bool *ladder_pos );
 // 戦術的特徴用の関数
-bool CheckLadderExtension( const game_info_t *game, int color, int pos );
+bool CheckLadderExtension( game_info_t *game, int color, int pos );
 #endif
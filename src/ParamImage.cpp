@@ -0,0 +1,249 @@
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sys/stat.h>
+#if !defined (_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "ParamImage.h"
+
+using namespace std;
+
+
+//////////////
+//  構造体  //
+//////////////
+
+// ファイルの先頭
+struct param_image_header_t {
+  char magic[8];              // "RAYPARAM"
+  unsigned int version;       // PARAM_IMAGE_VERSION
+  unsigned int sections;      // 区画の数
+  unsigned long long stamp;   // 元のテキストのサイズと更新時刻のハッシュ値
+};
+
+// 区画の位置 (ヘッダの後に区画の数だけ並べる)
+struct param_image_section_t {
+  unsigned long long offset;
+  unsigned long long size;
+};
+
+
+////////////
+//  定数  //
+////////////
+
+static const char param_image_magic[8] = { 'R', 'A', 'Y', 'P', 'A', 'R', 'A', 'M' };
+
+// 区画の先頭の境界
+static const size_t PARAM_IMAGE_ALIGN = 64;
+
+
+////////////////////////////
+//  ハッシュ値に混ぜる    //
+////////////////////////////
+static void
+Mix( unsigned long long *h, const unsigned long long v )
+{
+  *h ^= v;
+  *h *= 0x100000001b3ULL;
+}
+
+
+//////////////////////
+//  コンストラクタ  //
+//////////////////////
+ParamImage::ParamImage( const string &path, const vector<string> &sources )
+  : path(path), stamp(0xcbf29ce484222325ULL), image(nullptr), image_size(0)
+{
+  Mix(&stamp, PARAM_IMAGE_VERSION);
+  for (const string &source : sources) {
+    struct stat st;
+    if (stat(source.c_str(), &st) == 0) {
+      Mix(&stamp, (unsigned long long)st.st_size);
+      Mix(&stamp, (unsigned long long)st.st_mtime);
+    } else {
+      Mix(&stamp, ~0ULL);
+    }
+  }
+}
+
+
+////////////////////////////////
+//  イメージの読み込み        //
+////////////////////////////////
+bool
+ParamImage::Load( int sections )
+{
+  const char *data = nullptr;
+  size_t size = 0;
+
+#if defined (_WIN32)
+  // mmapが無いのでメモリに読み込む
+  FILE *fp;
+  if (fopen_s(&fp, path.c_str(), "rb") != 0) {
+    return false;
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || st.st_size <= 0) {
+    fclose(fp);
+    return false;
+  }
+  size = (size_t)st.st_size;
+  char *buf = new char[size];
+  if (fread(buf, 1, size, fp) != size) {
+    delete[] buf;
+    fclose(fp);
+    return false;
+  }
+  fclose(fp);
+  data = buf;
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  size = (size_t)st.st_size;
+  void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  data = (const char *)map;
+#endif
+
+  // ヘッダと区画の位置の確認
+  bool valid = size >= sizeof(param_image_header_t);
+  if (valid) {
+    const param_image_header_t *header = (const param_image_header_t *)data;
+    valid = memcmp(header->magic, param_image_magic, sizeof(param_image_magic)) == 0 &&
+      header->version == PARAM_IMAGE_VERSION &&
+      header->sections == (unsigned int)sections &&
+      header->stamp == stamp &&
+      size >= sizeof(param_image_header_t) + sections * sizeof(param_image_section_t);
+  }
+  if (valid) {
+    const param_image_section_t *section = (const param_image_section_t *)(data + sizeof(param_image_header_t));
+    for (int i = 0; i < sections && valid; i++) {
+      valid = section[i].offset % PARAM_IMAGE_ALIGN == 0 &&
+        section[i].offset <= size && section[i].size <= size - section[i].offset;
+    }
+  }
+
+  if (!valid) {
+#if defined (_WIN32)
+    delete[] data;
+#else
+    munmap((void *)data, size);
+#endif
+    return false;
+  }
+
+  image = data;
+  image_size = size;
+
+  return true;
+}
+
+
+////////////////////////////
+//  区画の先頭を返す      //
+////////////////////////////
+const void *
+ParamImage::Section( int i, size_t size ) const
+{
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  const param_image_header_t *header = (const param_image_header_t *)image;
+  const param_image_section_t *section = (const param_image_section_t *)(image + sizeof(param_image_header_t));
+
+  if (i < 0 || i >= (int)header->sections || section[i].size != size) {
+    return nullptr;
+  }
+
+  return image + section[i].offset;
+}
+
+
+//////////////////////////
+//  書き出す区画の追加  //
+//////////////////////////
+void
+ParamImage::Add( const void *data, size_t size )
+{
+  add_data.push_back(data);
+  add_size.push_back(size);
+}
+
+
+////////////////////////////
+//  イメージの書き出し    //
+////////////////////////////
+bool
+ParamImage::Save() const
+{
+  const int sections = (int)add_data.size();
+  param_image_header_t header;
+  vector<param_image_section_t> section(sections);
+  static const char padding[PARAM_IMAGE_ALIGN] = { 0 };
+
+  memcpy(header.magic, param_image_magic, sizeof(param_image_magic));
+  header.version = PARAM_IMAGE_VERSION;
+  header.sections = sections;
+  header.stamp = stamp;
+
+  unsigned long long offset = sizeof(param_image_header_t) + sections * sizeof(param_image_section_t);
+  for (int i = 0; i < sections; i++) {
+    offset = (offset + PARAM_IMAGE_ALIGN - 1) / PARAM_IMAGE_ALIGN * PARAM_IMAGE_ALIGN;
+    section[i].offset = offset;
+    section[i].size = add_size[i];
+    offset += add_size[i];
+  }
+
+  // 他のプロセスが読みかけのファイルを壊さないように,
+  // 別の名前で書いてから置き換える
+  const string tmp_path = path + "." + to_string(random_device{}()) + ".tmp";
+  FILE *fp;
+#if defined (_WIN32)
+  if (fopen_s(&fp, tmp_path.c_str(), "wb") != 0) {
+    return false;
+  }
+#else
+  fp = fopen(tmp_path.c_str(), "wb");
+  if (fp == NULL) {
+    return false;
+  }
+#endif
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+    (sections == 0 || fwrite(section.data(), sizeof(param_image_section_t), sections, fp) == (size_t)sections);
+  unsigned long long written = sizeof(param_image_header_t) + sections * sizeof(param_image_section_t);
+  for (int i = 0; i < sections && ok; i++) {
+    ok = fwrite(padding, 1, (size_t)(section[i].offset - written), fp) == section[i].offset - written &&
+      fwrite(add_data[i], 1, add_size[i], fp) == add_size[i];
+    written = section[i].offset + add_size[i];
+  }
+  ok = (fclose(fp) == 0) && ok;
+
+  if (ok) {
+#if defined (_WIN32)
+    remove(path.c_str());
+#endif
+    ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+  }
+  if (!ok) {
+    remove(tmp_path.c_str());
+  }
+
+  return ok;
+}
@@ -0,0 +1,55 @@
+#ifndef _PARAMIMAGE_H_
+#define _PARAMIMAGE_H_
+
+#include <string>
+#include <vector>
+
+
+////////////
+//  定数  //
+////////////
+
+// イメージの形式のバージョン
+// (表の作り方や並びを変えた時は上げる)
+const unsigned int PARAM_IMAGE_VERSION = 2;
+
+
+//////////////
+//  クラス  //
+//////////////
+
+// パラメータのイメージファイル
+// テキストのパラメータから作った表をそのまま並べたファイルで,
+// 2回目からはmmapして表として使う (複数のプロセスでページを共有できる).
+// 元のテキストのサイズか更新時刻が変わっていれば作り直す
+class ParamImage {
+public:
+  ParamImage( const std::string &path, const std::vector<std::string> &sources );
+
+  //  イメージを読み込む (無い, 古い, 壊れている時はfalse)
+  bool Load( int sections );
+
+  //  i番目の区画の先頭 (サイズが違えばnullptr)
+  //  Loadしたイメージはプロセスの終了まで残す
+  const void *Section( int i, size_t size ) const;
+
+  //  書き出す区画の追加 (dataはSaveまで残しておく事)
+  void Add( const void *data, size_t size );
+
+  //  Addした区画を書き出す (書けなければfalse)
+  bool Save() const;
+
+private:
+  std::string path;
+  unsigned long long stamp;
+
+  // Loadしたイメージ
+  const char *image;
+  size_t image_size;
+
+  // Addした区画
+  std::vector<const void*> add_data;
+  std::vector<size_t> add_size;
+};
+
+#endif
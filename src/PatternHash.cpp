@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 
 #include "PatternHash.h"
@@ -10,7 +11,7 @@ using namespace std;
 ////////////
 
 // bit
-const unsigned long long random_bitstrings[BIT_MAX][S_MAX] = {
+constexpr unsigned long long random_bitstrings[BIT_MAX][S_MAX] = {
   { 0xc96d191cf6f6aea6LLU, 0x401f7ac78bc80f1cLLU, 0xb5ee8cb6abe457f8LLU, 0xf258d22d4db91392LLU },
   { 0x04eef2b4b5d860ccLLU, 0x67a7aabe10d172d6LLU, 0x40565d50e72b4021LLU, 0x05d07b7d1e8de386LLU },
   { 0x8548dea130821accLLU, 0x583c502c832e0a3aLLU, 0x4631aede2e67ffd1LLU, 0x8f9fccba4388a61fLLU },
@@ -73,6 +74,31 @@ const unsigned long long random_bitstrings[BIT_MAX][S_MAX] = {
   { 0xffb5a3079c5f3418LLU, 0x3373d7f543f1ab0dLLU, 0x8d84012afc9aa746LLU, 0xb287a6f25e5acdf8LLU },
 };
 
+// 4点(1バイト)分の値毎にrandom_bitstringsをXORしておいた表
+// MD2, MD3, MD4, MD5の点はそれぞれ4点の倍数なので,
+// 点毎に12～20回引いていたのをバイト毎の3～5回で済ませる.
+// 表はコンパイル時に作る
+const int BYTE_HASH_MAX = BIT_MAX / 4;
+
+struct byte_hash_table_t {
+  unsigned long long hash[BYTE_HASH_MAX][256];
+
+  constexpr byte_hash_table_t() : hash() {
+    for (int i = 0; i < BYTE_HASH_MAX; i++) {
+      for (int v = 0; v < 256; v++) {
+        unsigned long long h = 0;
+        for (int j = 0; j < 4; j++) {
+          h ^= random_bitstrings[i * 4 + j][(v >> (j * 2)) & 0x3];
+        }
+        hash[i][v] = h;
+      }
+    }
+  }
+};
+
+static constexpr byte_hash_table_t byte_hash;
+
+
 ////////////
 //  関数  //
 ////////////
@@ -140,53 +166,87 @@ PatternHash( const pattern_t *pat, pattern_hash_t *hash_pat )
 /////////////////////////////
 //  パターンのハッシュ関数  //
 /////////////////////////////
-static unsigned long long
-MD2Hash( const unsigned int md2 )
+//  先頭から何バイト目の表かをfirstで指定
+static inline unsigned long long
+ByteHash( const unsigned long long pat, const int first, const int bytes )
 {
   unsigned long long hash = 0;
 
-  for (int i = 0; i < 12; i++) {
-    hash ^= random_bitstrings[i][(md2 >> (i * 2)) & 0x3];
+  for (int i = 0; i < bytes; i++) {
+    hash ^= byte_hash.hash[first + i][(pat >> (i * 8)) & 0xFF];
   }
 
   return hash;
 }
 
 static unsigned long long
-MD3Hash( const unsigned int md3 )
+MD2Hash( const unsigned int md2 )
 {
-  unsigned long long hash = 0;
-
-  for (int i = 0; i < 12; i++) {
-    hash ^= random_bitstrings[i + 12][(md3 >> (i * 2)) & 0x3];
-  }
+  return ByteHash(md2, 0, 3);
+}
 
-  return hash;
+static unsigned long long
+MD3Hash( const unsigned int md3 )
+{
+  return ByteHash(md3, 3, 3);
 }
 
 
 static unsigned long long
 MD4Hash( const unsigned int md4 )
 {
-  unsigned long long hash = 0;
-
-  for (int i = 0; i < 16; i++) {
-    hash ^= random_bitstrings[i + 24][(md4 >> (i * 2)) & 0x3];
-  }
-  
-  return hash;
+  return ByteHash(md4, 6, 4);
 }
 
 static unsigned long long
 MD5Hash( const unsigned long long md5 )
 {
-  unsigned long long hash = 0;
+  return ByteHash(md5, 10, 5);
+}
+
+
+//////////////////////////////////
+//  フィンガープリントとバケット  //
+//////////////////////////////////
+static inline unsigned int
+Fingerprint( const unsigned long long hash )
+{
+  const unsigned int fp = (unsigned int)(hash >> 32);
+
+  return fp != 0 ? fp : 1;
+}
+
+
+static inline unsigned int
+FirstBucket( const unsigned long long hash, const unsigned int mask )
+{
+  return (unsigned int)hash & mask;
+}
 
-  for (int i = 0; i < 20; i++) {
-    hash ^= random_bitstrings[i + 40][(md5 >> (i * 2)) & 0x3];
+
+static inline unsigned int
+SecondBucket( const unsigned long long hash, const unsigned int mask )
+{
+  const unsigned int first = FirstBucket(hash, mask);
+  const unsigned int second = (first ^ ((Fingerprint(hash) * 0x9E3779B1U) >> 7)) & mask;
+
+  return second != first ? second : first ^ 1;
+}
+
+
+//////////////////////////
+//  バケットの中を探索  //
+//////////////////////////
+static inline int
+SearchBucket( const pattern_bucket_t &bucket, const unsigned int fp )
+{
+  for (int i = 0; i < PATTERN_BUCKET_SLOTS; i++) {
+    if (bucket.fingerprint[i] == fp) {
+      return bucket.index[i];
+    }
   }
 
-  return hash;
+  return -1;
 }
 
 
@@ -194,23 +254,160 @@ MD5Hash( const unsigned long long md5 )
 //  データを探索  //
 ////////////////////
 int
-SearchIndex( const index_hash_t *index, const unsigned long long hash )
+SearchIndex( const pattern_index_t &index, const unsigned long long hash )
 {
-  const int key = TRANS20(hash);
-  int i;
+  const unsigned int fp = Fingerprint(hash);
+  const pattern_bucket_t &first = index.bucket[FirstBucket(hash, index.mask)];
+  const int id = SearchBucket(first, fp);
 
-  if (key >= HASH_MAX) cerr << "Over Run" << endl;
+  // ほとんどは1つ目のバケットで決まる
+  if (id != -1 || first.overflow == 0) {
+    return id;
+  }
 
-  i = key;
-  do{
-    if (index[i].hash == 0){
-      return index[i].index;
-    } else if (index[i].hash == hash) {
-      return index[i].index;
+  return SearchBucket(index.bucket[SecondBucket(hash, index.mask)], fp);
+}
+
+
+////////////////////////////////////////////////
+//  パターンをバケットに置けるか              //
+//  (同じバケットに同じフィンガープリントは   //
+//   置けない)                                //
+////////////////////////////////////////////////
+static bool
+CanPlace( const vector<unsigned long long> &hash, const vector<int> &slot,
+          const unsigned int b, const int skip, const int id )
+{
+  const unsigned int fp = Fingerprint(hash[id]);
+
+  for (int i = 0; i < PATTERN_BUCKET_SLOTS; i++) {
+    const int other = slot[b * PATTERN_BUCKET_SLOTS + i];
+    if (i != skip && other != -1 && Fingerprint(hash[other]) == fp) {
+      return false;
     }
-    i++;
-    if (i >= HASH_MAX) i = 0;
-  } while (i != key);
+  }
 
-  return -1;
+  return true;
+}
+
+
+//////////////////////////////////////////
+//  空いている場所に置く (置けたらtrue)  //
+//////////////////////////////////////////
+static bool
+PlaceEmpty( const vector<unsigned long long> &hash, vector<int> &slot, const unsigned int b, const int id )
+{
+  if (!CanPlace(hash, slot, b, -1, id)) {
+    return false;
+  }
+
+  for (int i = 0; i < PATTERN_BUCKET_SLOTS; i++) {
+    if (slot[b * PATTERN_BUCKET_SLOTS + i] == -1) {
+      slot[b * PATTERN_BUCKET_SLOTS + i] = id;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+////////////////////////////////////////////////////
+//  バケットの数を決めてパターンを置く            //
+//  (置けなかった時, 引けない時はfalse)           //
+////////////////////////////////////////////////////
+static bool
+PlacePatterns( const vector<unsigned long long> &hash, const unsigned int mask, vector<pattern_bucket_t> &bucket )
+{
+  const int kick_max = 500;
+  const unsigned int buckets = mask + 1;
+  vector<int> slot(buckets * PATTERN_BUCKET_SLOTS, -1);
+  unsigned int turn = 0;
+
+  for (int i = 0; i < (int)hash.size(); i++) {
+    const unsigned int b1 = FirstBucket(hash[i], mask), b2 = SecondBucket(hash[i], mask);
+    bool duplicate = false;
+
+    // ハッシュ値が0のパターンと同じパターンの2つ目以降は引かない
+    for (int j = 0; j < PATTERN_BUCKET_SLOTS; j++) {
+      const int s1 = slot[b1 * PATTERN_BUCKET_SLOTS + j], s2 = slot[b2 * PATTERN_BUCKET_SLOTS + j];
+      if ((s1 != -1 && hash[s1] == hash[i]) || (s2 != -1 && hash[s2] == hash[i])) {
+        duplicate = true;
+      }
+    }
+    if (hash[i] == 0 || duplicate) {
+      continue;
+    }
+
+    // 空いていなければ他のパターンを追い出して, もう1つのバケットに移す
+    int id = i;
+    unsigned int b = b1;
+    bool placed = false;
+    for (int kick = 0; kick < kick_max && !placed; kick++) {
+      const unsigned int c1 = FirstBucket(hash[id], mask), c2 = SecondBucket(hash[id], mask);
+      if (PlaceEmpty(hash, slot, c1, id) || PlaceEmpty(hash, slot, c2, id)) {
+        placed = true;
+        break;
+      }
+      b = (b == c1) ? c2 : c1;
+      const int victim_slot = turn++ % PATTERN_BUCKET_SLOTS;
+      if (!CanPlace(hash, slot, b, victim_slot, id)) {
+        continue;
+      }
+      const int victim = slot[b * PATTERN_BUCKET_SLOTS + victim_slot];
+      slot[b * PATTERN_BUCKET_SLOTS + victim_slot] = id;
+      id = victim;
+    }
+    if (!placed) {
+      return false;
+    }
+  }
+
+  bucket.assign(buckets, pattern_bucket_t());
+  for (unsigned int b = 0; b < buckets; b++) {
+    for (int i = 0; i < PATTERN_BUCKET_SLOTS; i++) {
+      const int id = slot[b * PATTERN_BUCKET_SLOTS + i];
+      bucket[b].fingerprint[i] = (id == -1) ? 0 : Fingerprint(hash[id]);
+      bucket[b].index[i] = id;
+      if (id != -1 && b != FirstBucket(hash[id], mask)) {
+        bucket[FirstBucket(hash[id], mask)].overflow = 1;
+      }
+    }
+  }
+
+  // 他のパターンのフィンガープリントに当たらずに引けるか確認
+  const pattern_index_t index = { bucket.data(), mask };
+  for (int i = 0; i < (int)hash.size(); i++) {
+    const int id = SearchIndex(index, hash[i]);
+    if (hash[i] != 0 && (id == -1 || hash[id] != hash[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+//////////////////////////
+//  インデックスの作成  //
+//////////////////////////
+unsigned int
+MakePatternIndex( const vector<unsigned long long> &hash, vector<pattern_bucket_t> &bucket )
+{
+  // 埋まるのが半分以下になるバケットの数から始めて,
+  // 置けなければ倍にする
+  unsigned int buckets = 2;
+
+  while ((size_t)buckets * PATTERN_BUCKET_SLOTS < hash.size() * 2) {
+    buckets *= 2;
+  }
+
+  for (; buckets <= (1U << 24); buckets *= 2) {
+    if (PlacePatterns(hash, buckets - 1, bucket)) {
+      return buckets - 1;
+    }
+  }
+
+  cerr << "Can not make pattern index" << endl;
+  exit(1);
 }
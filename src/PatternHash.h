@@ -1,23 +1,37 @@
 #ifndef _PATTERNHASH_H_
 #define _PATTERNHASH_H_
 
+#include <vector>
+
 #include "GoBoard.h"
 #include "Pattern.h"
 
-const int HASH_MAX = 1048576; // 2^20
 const int BIT_MAX = 60;
 
-#define TRANS20(hash)	(((hash&0xFFFFFFFF)^((hash>>32)&0xFFFFFFFF))&0xFFFFF)
+// 1つのバケットに入るパターンの数
+const int PATTERN_BUCKET_SLOTS = 7;
 
 // パターン
 struct pattern_hash_t {
   unsigned long long list[MD_MAX + MD_LARGE_MAX];
 };
 
-// インデックス 
-struct index_hash_t {
-  unsigned long long hash;
-  int index;
+// インデックスのバケット (1つで1キャッシュライン)
+// ハッシュ値の下位ビットで1つ目のバケットを決め,
+// 上位32ビットをフィンガープリントとして持つ
+struct pattern_bucket_t {
+  unsigned int fingerprint[PATTERN_BUCKET_SLOTS];  // 0は空き
+  unsigned int overflow;                           // ここが1つ目で2つ目のバケットに入れたパターンがあれば1
+  int index[PATTERN_BUCKET_SLOTS];
+  int padding;
+};
+
+static_assert(sizeof(pattern_bucket_t) == 64, "pattern_bucket_t must fit a cache line");
+
+// インデックス (2択のカッコーハッシュ)
+struct pattern_index_t {
+  const pattern_bucket_t *bucket;
+  unsigned int mask;  // バケットの数 - 1
 };
 
 ////////////
@@ -27,7 +41,10 @@ struct index_hash_t {
 //  パターンのハッシュ関数
 void PatternHash( const pattern_t *pat, pattern_hash_t *hash_pat );
 
-//  インデックスを探索
-int SearchIndex( const index_hash_t *index, const unsigned long long hash );
+//  インデックスを探索 (無ければ-1)
+int SearchIndex( const pattern_index_t &index, const unsigned long long hash );
+
+//  hash[i] のインデックスが i になるバケットを作り, マスクを返す
+unsigned int MakePatternIndex( const std::vector<unsigned long long> &hash, std::vector<pattern_bucket_t> &bucket );
 
 #endif	// _PATTTERNHASH_H_ 
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <iomanip>
+#include <string>
+
+#include "PlayoutStat.h"
+
+using namespace std;
+
+
+////////////////
+//  大域変数  //
+////////////////
+
+thread_local playout_stat_t *thread_playout_stat = nullptr;
+
+// 計測するか
+static atomic<bool> playout_stat_flag(false);
+
+// 探索スレッド毎の計測値
+static playout_stat_t playout_stat[PLAYOUT_STAT_THREAD_MAX];
+
+// 書き込み先にしたスレッドの数
+static atomic<int> playout_stat_threads(0);
+
+
+//////////////////////////
+//  計測の有効/無効     //
+//////////////////////////
+void
+SetPlayoutStat( bool flag )
+{
+  playout_stat_flag.store(flag, memory_order_relaxed);
+}
+
+
+bool
+GetPlayoutStat( void )
+{
+  return playout_stat_flag.load(memory_order_relaxed);
+}
+
+
+////////////////////////
+//  計測値のクリア    //
+////////////////////////
+void
+ClearPlayoutStat( void )
+{
+  for (auto &stat : playout_stat) {
+    for (auto &c : stat.count) {
+      c.store(0, memory_order_relaxed);
+    }
+  }
+}
+
+
+//////////////////////////////////////
+//  計測値の書き込み先を決める      //
+//////////////////////////////////////
+void
+BindPlayoutStat( int thread_id )
+{
+  if (!playout_stat_flag.load(memory_order_relaxed) || thread_id >= PLAYOUT_STAT_THREAD_MAX) {
+    thread_playout_stat = nullptr;
+    return;
+  }
+
+  int threads = playout_stat_threads.load();
+  while (threads <= thread_id &&
+         !playout_stat_threads.compare_exchange_weak(threads, thread_id + 1)) {
+  }
+  thread_playout_stat = &playout_stat[thread_id];
+}
+
+
+//////////////////////////////////////////
+//  割合(%)の文字列 (分母が0なら "-")   //
+//////////////////////////////////////////
+static string
+Rate( const long long num, const long long den )
+{
+  char buf[16];
+
+  if (den == 0) {
+    return "       -";
+  }
+  snprintf(buf, sizeof(buf), "%8.1f", 100.0 * num / den);
+
+  return buf;
+}
+
+
+//////////////////////////////
+//  1行分の計測値の出力     //
+//////////////////////////////
+static void
+PrintPlayoutStatLine( ostream &out, const char *name, const long long count[] )
+{
+  const long long playouts = count[PO_PLAYOUTS], moves = count[PO_MOVES];
+  const long long restores = count[PO_RESTORES];
+  const double sec = count[PO_PLAYOUT_TIME] * 1e-9;
+
+  out << setw(6) << name
+      << setw(10) << playouts
+      << setw(8) << setprecision(1) << (playouts > 0 ? (double)moves / playouts : 0.0)
+      << setw(10) << setprecision(0) << (sec > 0 ? playouts / sec : 0.0)
+      << setw(11) << (sec > 0 ? moves / sec : 0.0)
+      << setw(8) << setprecision(1) << (count[PO_PLAYOUT_TIME] > 0 ? 100.0 * count[PO_RATING_TIME] / count[PO_PLAYOUT_TIME] : 0.0)
+      << setw(8) << (moves > 0 ? 100.0 * count[PO_REPLACE] / moves : 0.0)
+      << setw(8) << (playouts > 0 ? 100.0 * count[PO_MERCY] / playouts : 0.0)
+      << Rate(count[PO_TGR1_USED], count[PO_TGR1_TRY])
+      << Rate(count[PO_LGRF1_USED], count[PO_LGRF1_TRY])
+      << Rate(count[PO_LGRF2_USED], count[PO_LGRF2_TRY])
+      << setw(12) << setprecision(0) << (restores > 0 ? (double)count[PO_RESTORE_TIME] / restores : 0.0)
+      << setw(6) << setprecision(1) << (restores > 0 ? (double)count[PO_RESTORE_ROWS] / restores : 0.0)
+      << endl;
+}
+
+
+////////////////////////////
+//  計測値の出力          //
+////////////////////////////
+void
+PrintPlayoutStat( ostream &out )
+{
+  const int threads = playout_stat_threads.load();
+  long long total[PO_COUNTER_MAX] = { 0 };
+
+  out << "playout stat (" << (playout_stat_flag.load(memory_order_relaxed) ? "on" : "off") << ")" << endl;
+  out << fixed;
+  out << "thread  playouts  length    PO/sec  moves/sec rating% replace%  mercy%   TGR1%  LGRF1%  LGRF2% restore(ns)  rows" << endl;
+  for (int i = 0; i < threads; i++) {
+    long long count[PO_COUNTER_MAX];
+    for (int j = 0; j < PO_COUNTER_MAX; j++) {
+      count[j] = playout_stat[i].count[j].load(memory_order_relaxed);
+      total[j] += count[j];
+    }
+    PrintPlayoutStatLine(out, to_string(i).c_str(), count);
+  }
+  PrintPlayoutStatLine(out, "total", total);
+}
@@ -0,0 +1,103 @@
+#ifndef _PLAYOUTSTAT_H_
+#define _PLAYOUTSTAT_H_
+
+#include <atomic>
+#include <ostream>
+
+#include "Utility.h"
+
+
+////////////
+//  定数  //
+////////////
+
+// プレイアウトの計測項目
+enum PLAYOUT_COUNTER {
+  PO_PLAYOUTS,      // プレイアウトの回数
+  PO_MOVES,         // プレイアウトの手数
+  PO_MERCY,         // 石数の差で打ち切った回数
+  PO_REPLACE,       // ReplaceMoveで置き換えた着手
+  PO_TGR1_TRY,      // TGR1を引いた回数
+  PO_TGR1_USED,     // TGR1の手を打った回数
+  PO_LGRF1_TRY,
+  PO_LGRF1_USED,
+  PO_LGRF2_TRY,
+  PO_LGRF2_USED,
+  PO_PLAYOUT_TIME,  // プレイアウトの時間(ns)
+  PO_RATING_TIME,   // PartialRatingの時間(ns)
+  PO_RESTORES,      // RestoreGameの回数
+  PO_RESTORE_ROWS,  // RestoreGameで戻した行の数
+  PO_RESTORE_TIME,  // RestoreGameの時間(ns)
+  PO_COUNTER_MAX,
+};
+
+
+//////////////
+//  構造体  //
+//////////////
+
+// 計測値を持てる探索スレッドの数
+const int PLAYOUT_STAT_THREAD_MAX = 256;
+
+// スレッド毎の計測値
+// 書くのはそのスレッドだけなので, 他のスレッドと
+// キャッシュラインを共有しないようにしておく
+struct alignas(64) playout_stat_t {
+  std::atomic<long long> count[PO_COUNTER_MAX];
+};
+
+
+////////////////
+//  大域変数  //
+////////////////
+
+// このスレッドの計測値の書き込み先 (nullptrなら計測しない)
+extern thread_local playout_stat_t *thread_playout_stat;
+
+
+////////////
+//  関数  //
+////////////
+
+//  計測の有効/無効
+void SetPlayoutStat( bool flag );
+bool GetPlayoutStat( void );
+
+//  計測値のクリア
+void ClearPlayoutStat( void );
+
+//  探索スレッドの開始時に計測値の書き込み先を決める
+void BindPlayoutStat( int thread_id );
+
+//  スレッド毎と合計の計測値の出力
+void PrintPlayoutStat( std::ostream &out );
+
+//  計測値の加算 (計測しない時は何もしない)
+inline void
+CountPlayoutStat( const PLAYOUT_COUNTER counter, const long long n )
+{
+  playout_stat_t *stat = thread_playout_stat;
+
+  if (stat != nullptr) {
+    std::atomic<long long> &c = stat->count[counter];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+}
+
+//  計測の開始時刻 (計測しない時は取らない)
+inline ray_clock::time_point
+PlayoutStatClock( void )
+{
+  return thread_playout_stat != nullptr ? ray_clock::now() : ray_clock::time_point();
+}
+
+//  開始時刻からの時間の加算
+inline void
+CountPlayoutStatTime( const PLAYOUT_COUNTER counter, const ray_clock::time_point &start )
+{
+  if (thread_playout_stat != nullptr) {
+    CountPlayoutStat(counter, std::chrono::duration_cast<std::chrono::nanoseconds>(ray_clock::now() - start).count());
+  }
+}
+
+#endif
@@ -10,10 +10,13 @@
 #include <string>
 #include <numeric>
 #include <set>
+#include <vector>
 
 #include "Message.h"
 #include "MoveCache.h"
 #include "Nakade.h"
+#include "ParamImage.h"
+#include "PlayoutStat.h"
 #include "Point.h"
 #include "Rating.h"
 #include "Semeai.h"
@@ -30,10 +33,10 @@ using namespace std;
 float po_tactical_features[TACTICAL_FEATURE_MAX];
 // 3x3パターンのγ値
 float po_pat3[PAT3_MAX];
-// MD2のパターンのγ値
-float po_md2[MD2_MAX];
-// 3x3とMD2のパターンのγ値の積
-float po_pattern[MD2_MAX];
+// 3x3とMD2のパターンのγ値の積 (イメージか po_pattern_table を指す)
+const float *po_pattern;
+// テキストから作った時の po_pattern の実体
+static vector<float> po_pattern_table;
 // 学習した着手距離の特徴 
 float po_neighbor_orig[PREVIOUS_DISTANCE_MAX];
 // 補正した着手距離の特徴
@@ -288,60 +291,47 @@ RatingMove(game_info_t *game, int color, std::mt19937_64 *mt, LGR& lgr)
   static char stone[] = { '+', 'B', 'W', '#' };
 
   // レートの部分更新
+  const ray_clock::time_point rating_start = PlayoutStatClock();
   PartialRating(game, color, sum_rate, sum_rate_row, rate);
+  CountPlayoutStatTime(PO_RATING_TIME, rating_start);
   if (*sum_rate > 0) {
       // LGR
     if (((*mt)() % 100) < tgr1_rate && game->moves > 0) {
-      static std::atomic<uint64_t> lgr_total;
-      static std::atomic<uint64_t> lgr_hit;
-      std::atomic_fetch_add(&lgr_total, (uint64_t)1);
+      CountPlayoutStat(PO_TGR1_TRY, 1);
       int pos1 = game->record[game->moves - 1].pos;
       pos = lgr.getTGR1(color, pos1, game);
 
       if (pos != PASS && rate[pos] > 0) {
-	std::atomic_fetch_add(&lgr_hit, (uint64_t)1);
 	if (IsLegalNotEye(game, pos, color)) {
+	  CountPlayoutStat(PO_TGR1_USED, 1);
 	  return pos;
 	}
       }
-      if (lgr_total % 1000000 == 0 && GetDebugMessageMode()) {
-	cerr << "TGR1 " << (100.0 * lgr_hit / lgr_total) << "%" << endl;
-      }
     }
     if (((*mt)() % 100) < lgrf1_rate && game->moves > 0) {
-      static std::atomic<uint64_t> lgr_total;
-      static std::atomic<uint64_t> lgr_hit;
-      std::atomic_fetch_add(&lgr_total, (uint64_t)1);
+      CountPlayoutStat(PO_LGRF1_TRY, 1);
       int pos1 = game->record[game->moves - 1].pos;
       pos = lgr.getLGRF1(color, pos1, game);
       if (pos != PASS && rate[pos] > 0) {
-	std::atomic_fetch_add(&lgr_hit, (uint64_t)1);
 	if (IsLegalNotEye(game, pos, color)) {
+	  CountPlayoutStat(PO_LGRF1_USED, 1);
 	  return pos;
 	}
       }
-      if (lgr_total % 1000000 == 0 && GetDebugMessageMode()) {
-	cerr << "LGRF1 " << (100.0 * lgr_hit / lgr_total) << "%" << endl;
-      }
     }
 
     if (use_lgrf2 && game->moves > 1) {
-      static std::atomic<uint64_t> lgr_total;
-      static std::atomic<uint64_t> lgr_hit;
-      std::atomic_fetch_add(&lgr_total, (uint64_t)1);
+      CountPlayoutStat(PO_LGRF2_TRY, 1);
       int pos1 = game->record[game->moves - 2].pos;
       int pos2 = game->record[game->moves - 1].pos;
       pos = lgr.getLGRF2(color, pos1, pos2);
       if (pos != PASS && rate[pos] > 0) {
-	std::atomic_fetch_add(&lgr_hit, (uint64_t)1);
 	if (IsLegalNotEye(game, pos, color)) {
 	  //cerr << "Use LGRF2 " << FormatMove(pos1) << " -> " << FormatMove(pos2) << " -> " << FormatMove(pos) << endl;
+	  CountPlayoutStat(PO_LGRF2_USED, 1);
 	  return pos;
 	}
       }
-      if (lgr_total % 1000000 == 0 && GetDebugMessageMode()) {
-	cerr << "LGRF2 " << (100 * lgr_hit / lgr_total) << "%" << std::endl;
-      }
     }
   }
 
@@ -387,14 +377,14 @@ RatingMove(game_info_t *game, int color, std::mt19937_64 *mt, LGR& lgr)
           int rep = replace[(*mt)() % replace_num];
           if (IsLegalNotEye(game, rep, color)) {
             //if (game->moves < 300) { PrintBoard(game); cerr << "REPLACE " << stone[color] << " " << FormatMove(pos) << " -> " << FormatMove(rep) << endl; }
+            CountPlayoutStat(PO_REPLACE, 1);
             return rep;
           }
         }
       }
       break;
     } else {
-      *sum_rate -= rate[pos];
-      sum_rate_row[y] -= rate[pos];
+      UpdateRateSum(sum_rate, sum_rate_row, pos, -rate[pos]);
       rate[pos] = 0;
     }
   }
@@ -437,6 +427,7 @@ NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *su
 {
   int i, pos;
   double gamma;
+  long long old_rate;
   double bias[4];
   bool self_atari_flag;
 
@@ -463,9 +454,8 @@ NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *su
       if (flag[pos] && bias[i] == 1.0) continue;
       self_atari_flag = PoCheckSelfAtari(game, color, pos);
 
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      // 元のレート
+      old_rate = rate[pos];
 
       if (!self_atari_flag){
 	rate[pos] = 0;
@@ -477,11 +467,9 @@ NeighborUpdate( game_info_t *game, int color, long long *sum_rate, long long *su
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	gamma *= bias[i];
 	rate[pos] = (long long)(gamma)+1;
-
-	// 新たに計算したレートを代入
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];
       }
+      // 新たに計算したレートとの差を反映
+      UpdateRateSum(sum_rate, sum_rate_row, pos, rate[pos] - old_rate);
 
       game->tactical_features1[pos] = 0;
       game->tactical_features2[pos] = 0;
@@ -499,6 +487,7 @@ NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_
 {
   int i, pos, dis;
   double gamma;
+  long long old_rate;
   bool self_atari_flag;
 
   for (i = 0; i < nakade_num; i++) {
@@ -506,9 +495,8 @@ NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_
     if (pos != NOT_NAKADE && game->candidates[pos]){
       self_atari_flag = PoCheckSelfAtari(game, color, pos);
 
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      // 元のレート
+      old_rate = rate[pos];
 
       if (!self_atari_flag) {
 	rate[pos] = 0;
@@ -524,10 +512,9 @@ NakadeUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	rate[pos] = (long long)(gamma) + 1;
-	// 新たに計算したレートを代入      
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];     
       }
+      // 新たに計算したレートとの差を反映
+      UpdateRateSum(sum_rate, sum_rate_row, pos, rate[pos] - old_rate);
 
       game->tactical_features1[pos] = 0;
       game->tactical_features2[pos] = 0;
@@ -545,6 +532,7 @@ OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_r
 {
   int i, pos;
   double gamma;
+  long long old_rate;
   bool self_atari_flag;
 
   for (i = 0; i < update_num; i++) {
@@ -554,9 +542,8 @@ OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_r
     if (game->candidates[pos]) {
       self_atari_flag = PoCheckSelfAtari(game, color, pos);
 
-      // 元あったレートを消去
-      *sum_rate -= rate[pos];
-      sum_rate_row[board_y[pos]] -= rate[pos];
+      // 元のレート
+      old_rate = rate[pos];
 
       // パターン、戦術的特徴、距離のγ値
       if (!self_atari_flag) {
@@ -567,11 +554,9 @@ OtherUpdate( game_info_t *game, int color, long long *sum_rate, long long *sum_r
 	gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	rate[pos] = (long long)(gamma) + 1;
-
-	// 新たに計算したレートを代入
-	*sum_rate += rate[pos];
-	sum_rate_row[board_y[pos]] += rate[pos];
       }
+      // 新たに計算したレートとの差を反映
+      UpdateRateSum(sum_rate, sum_rate_row, pos, rate[pos] - old_rate);
 
       game->tactical_features1[pos] = 0;
       game->tactical_features2[pos] = 0;
@@ -590,6 +575,7 @@ Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *
 {
   int i, j, pos;
   double gamma;
+  long long old_rate;
   bool self_atari_flag;
 
   for (i = 0; i < update_num; i++) {
@@ -600,9 +586,8 @@ Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *
       if (game->candidates[pos]) {
 	self_atari_flag = PoCheckSelfAtari(game, color, pos);
 
-	// 元あったレートを消去
-	*sum_rate -= rate[pos];
-	sum_rate_row[board_y[pos]] -= rate[pos];
+	// 元のレート
+	old_rate = rate[pos];
 
 	// パターン、戦術的特徴、距離のγ値
 	if (!self_atari_flag){
@@ -613,11 +598,9 @@ Neighbor12Update( game_info_t *game, int color, long long *sum_rate, long long *
 	  gamma *= po_tactical_set1[game->tactical_features1[pos]];
 	  gamma *= po_tactical_set2[game->tactical_features2[pos]];
 	  rate[pos] = (long long)(gamma) + 1;
-
-	  // 新たに計算したレートを代入
-	  *sum_rate += rate[pos];
-	  sum_rate_row[board_y[pos]] += rate[pos];
 	}
+	// 新たに計算したレートとの差を反映
+	UpdateRateSum(sum_rate, sum_rate_row, pos, rate[pos] - old_rate);
 
 	game->tactical_features1[pos] = 0;
 	game->tactical_features2[pos] = 0;
@@ -644,7 +627,7 @@ PartialRating( game_info_t *game, int color, long long *sum_rate, long long *sum
   int nakade_pos[4] = { 0 };
   int nakade_num = 0;
   int prev_feature = game->update_num[color];
-  int prev_feature_pos[PURE_BOARD_MAX];
+  int prev_feature_pos[UPDATE_POS_MAX];
 
   for (int i = 0; i < prev_feature; i++){
     prev_feature_pos[i] = update_pos[i];
@@ -712,7 +695,7 @@ Rating( game_info_t *game, int color, long long *sum_rate, long long *sum_rate_r
   int pm1 = PASS;
   double gamma;
   int update_num = 0;
-  int update_pos[PURE_BOARD_MAX];  
+  int update_pos[UPDATE_POS_MAX];  
   bool self_atari_flag;
   int dis;
 
@@ -1638,7 +1621,6 @@ InputPOGamma( void )
 {
   int i;
   string po_parameters_path = po_params_path;
-  string path;
 
 #if defined (_WIN32)
   po_parameters_path += '\\';
@@ -1646,42 +1628,72 @@ InputPOGamma( void )
   po_parameters_path += '/';
 #endif
 
-  // 戦術的特徴の読み込み
-  path = po_parameters_path + "TacticalFeature.txt";
-  InputTxtFLT(path.c_str(), po_tactical_features, TACTICAL_FEATURE_MAX);
+  const string tactical_path = po_parameters_path + "TacticalFeature.txt";
+  const string distance_path = po_parameters_path + "PreviousDistance.txt";
+  const string pat3_path = po_parameters_path + "Pat3.txt";
+  const string md2_path = po_parameters_path + "MD2.txt";
+
+  // 前回作ったイメージがあればそのまま使う
+  ParamImage image(po_parameters_path + "SimParamImage.bin",
+                   { tactical_path, distance_path, pat3_path, md2_path });
+  const void *tactical = nullptr, *distance = nullptr, *pat3 = nullptr, *pattern = nullptr;
+
+  if (image.Load(4)) {
+    tactical = image.Section(0, sizeof(po_tactical_features));
+    distance = image.Section(1, sizeof(po_neighbor_orig));
+    pat3 = image.Section(2, sizeof(po_pat3));
+    pattern = image.Section(3, sizeof(float) * MD2_MAX);
+  }
 
-  // 直前の着手からの距離の読み込み
-  path = po_parameters_path + "PreviousDistance.txt";
-  InputTxtFLT(path.c_str(), po_neighbor_orig, PREVIOUS_DISTANCE_MAX);
+  if (tactical != nullptr && distance != nullptr && pat3 != nullptr && pattern != nullptr) {
+    memcpy(po_tactical_features, tactical, sizeof(po_tactical_features));
+    memcpy(po_neighbor_orig, distance, sizeof(po_neighbor_orig));
+    memcpy(po_pat3, pat3, sizeof(po_pat3));
+    po_pattern = (const float *)pattern;
+  } else {
+    // 戦術的特徴の読み込み
+    InputTxtFLT(tactical_path.c_str(), po_tactical_features, TACTICAL_FEATURE_MAX);
 
-  // 直前の着手からの距離のγを補正して出力
-  for (i = 0; i < PREVIOUS_DISTANCE_MAX - 1; i++) {
-    po_previous_distance[i] = (float)(po_neighbor_orig[i] * neighbor_bias);
-  }
-  po_previous_distance[2] = (float)(po_neighbor_orig[2] * jump_bias);
+    // 直前の着手からの距離の読み込み
+    InputTxtFLT(distance_path.c_str(), po_neighbor_orig, PREVIOUS_DISTANCE_MAX);
 
-  // 3x3のパターンの読み込み
-  path = po_parameters_path + "Pat3.txt";
-  InputTxtFLT(path.c_str(), po_pat3, PAT3_MAX);
+    // 3x3のパターンの読み込み
+    InputTxtFLT(pat3_path.c_str(), po_pat3, PAT3_MAX);
 
-  // マンハッタン距離2のパターンの読み込み
-  path = po_parameters_path + "MD2.txt";
-  InputMD2(path.c_str(), po_md2);
+    // マンハッタン距離2のパターンの読み込み
+    vector<float> po_md2(MD2_MAX);
+    InputMD2(md2_path.c_str(), po_md2.data());
 
-  // 3x3とMD2のパターンをまとめる
-  for (i = 0; i < MD2_MAX; i++){
-    float r = po_md2[i] * po_pat3[i & 0xFFFF];
+    // 3x3とMD2のパターンをまとめる
+    po_pattern_table.resize(MD2_MAX);
+    for (i = 0; i < MD2_MAX; i++){
+      float r = po_md2[i] * po_pat3[i & 0xFFFF];
 
-    // 実際に目を潰す手は判定で打たれないので確率を落とさない
-    if (eye_condition[i & 0xFFFF] == E_COMPLETE_ONE_EYE
-      || eye_condition[i & 0xFFFF] == E_HALF_1_EYE) {
-      if (r < 1.0f) {
-        r = 1.0f;
+      // 実際に目を潰す手は判定で打たれないので確率を落とさない
+      if (eye_condition[i & 0xFFFF] == E_COMPLETE_ONE_EYE
+        || eye_condition[i & 0xFFFF] == E_HALF_1_EYE) {
+        if (r < 1.0f) {
+          r = 1.0f;
+        }
       }
+
+      po_pattern_table[i] = r * 100.0f;
     }
+    po_pattern = po_pattern_table.data();
+
+    // 次回のためにイメージを書き出す (書けなくても続ける)
+    image.Add(po_tactical_features, sizeof(po_tactical_features));
+    image.Add(po_neighbor_orig, sizeof(po_neighbor_orig));
+    image.Add(po_pat3, sizeof(po_pat3));
+    image.Add(po_pattern, sizeof(float) * MD2_MAX);
+    image.Save();
+  }
 
-    po_pattern[i] = r * 100.0f;
+  // 直前の着手からの距離のγを補正して出力
+  for (i = 0; i < PREVIOUS_DISTANCE_MAX - 1; i++) {
+    po_previous_distance[i] = (float)(po_neighbor_orig[i] * neighbor_bias);
   }
+  po_previous_distance[2] = (float)(po_neighbor_orig[2] * jump_bias);
 }
 
 
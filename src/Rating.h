@@ -126,8 +126,7 @@ const double PO_BIAS = 1.66542;
 extern float po_tactical_features[TACTICAL_FEATURE_MAX];
 extern float po_neighbor8[PREVIOUS_DISTANCE_MAX];
 extern float po_pat3[PAT3_MAX];
-extern float po_md2[MD2_MAX];
-extern float po_pattern[MD2_MAX];
+extern const float *po_pattern;
 extern float po_tactical_set1[PO_TACTICALS_MAX1];
 extern float po_tactical_set2[PO_TACTICALS_MAX2];
 
@@ -4,64 +4,57 @@
 #include "Pattern.h"
 #include "Semeai.h"
 
-// IsCapturableAtari関数用
-game_info_t capturable_game;
-// CheckOiotoshi関数用
-game_info_t oiotoshi_game;
-// CheckLibertyState関数用
-game_info_t liberty_game;
-// IsSelfAtariCapture関数用
-game_info_t capture_game;
-
 /////////////////////////
 //  1手で取れるか確認  //
 /////////////////////////
 bool
-IsCapturableAtari( const game_info_t *game, const int pos, const int color, const int opponent_pos )
+IsCapturableAtari( game_info_t *game, const int pos, const int color, const int opponent_pos )
 {
   string_t *string;
   const int *string_id;
   int other = FLIP_COLOR(color);
   int neighbor;
   int id;
-  int libs;
+  int escape;
+  bool capturable = true;
 
   if (!IsLegal(game, pos, color)) {
     return false;
   }
 
-  // 局面をコピー
-  CopyGame(&capturable_game, game);
-  // とりあえず石を置く
-  PutStone(&capturable_game, pos, color);
+  // とりあえず石を置く (調べた後に元に戻す)
+  BeginUndo(game);
+  PutStone(game, pos, color);
 
-  string = capturable_game.string;
-  string_id = capturable_game.string_id;
+  string = game->string;
+  string_id = game->string_id;
   id = string_id[opponent_pos];
 
   // 周囲に取り返せる石があれば安全
   neighbor = string[id].neighbor[0];
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
-      return false;
+      capturable = false;
+      break;
     }
     neighbor = string[id].neighbor[neighbor];
   }
 
-  if (!IsLegal(&capturable_game, string[string_id[opponent_pos]].lib[0], other)) {
-    return true;
-  }
-  // 逃げるつもりでダメに打つ
-  PutStone(&capturable_game, string[string_id[opponent_pos]].lib[0], other);
+  escape = string[id].lib[0];
+  if (capturable && IsLegal(game, escape, other)) {
+    // 逃げるつもりでダメに打つ
+    PutStone(game, escape, other);
 
-  libs = string[string_id[opponent_pos]].libs;
+    // 逃げても呼吸点が1つなら捕獲可能と判定
+    capturable = (string[string_id[opponent_pos]].libs == 1);
 
-  // 逃げても呼吸点が1つなら捕獲可能と判定
-  if (libs == 1) {
-    return true;
-  } else {
-    return false;
+    Undo(game);
   }
+
+  Undo(game);
+  EndUndo(game);
+
+  return capturable;
 }
 
 
@@ -70,41 +63,48 @@ IsCapturableAtari( const game_info_t *game, const int pos, const int color, cons
 ////////////////////////////////
 // 返り値がintとboolの違いだけでIsCapturableAtari関数と同じ
 int
-CheckOiotoshi( const game_info_t *game, const int pos, const int color, const int opponent_pos )
+CheckOiotoshi( game_info_t *game, const int pos, const int color, const int opponent_pos )
 {
   string_t *string;
   int *string_id;
   const int other = FLIP_COLOR(color);
   int neighbor;
-  int id, num = -1;
+  int id, escape, num = -1;
+  bool safe = false;
 
   if (!IsLegal(game, pos, color)) {
     return -1;
   }
 
-  CopyGame(&oiotoshi_game, game);
-  PutStone(&oiotoshi_game, pos, color);
-  string = oiotoshi_game.string;
-  string_id = oiotoshi_game.string_id;
+  BeginUndo(game);
+  PutStone(game, pos, color);
+  string = game->string;
+  string_id = game->string_id;
   id = string_id[opponent_pos];
 
   neighbor = string[id].neighbor[0];
   while (neighbor != NEIGHBOR_END) {
     if (string[neighbor].libs == 1) {
-      return -1;
+      safe = true;
+      break;
     }
     neighbor = string[id].neighbor[neighbor];
   }
 
-  if (!IsLegal(&oiotoshi_game, string[string_id[opponent_pos]].lib[0], other)) {
-    return -1;
-  }
-  PutStone(&oiotoshi_game, string[string_id[opponent_pos]].lib[0], other);
+  escape = string[id].lib[0];
+  if (!safe && IsLegal(game, escape, other)) {
+    PutStone(game, escape, other);
 
-  if (string[string_id[opponent_pos]].libs == 1) {
-    num = string[string_id[opponent_pos]].size;
+    if (string[string_id[opponent_pos]].libs == 1) {
+      num = string[string_id[opponent_pos]].size;
+    }
+
+    Undo(game);
   }
 
+  Undo(game);
+  EndUndo(game);
+
   return num;
 }
 
@@ -144,25 +144,26 @@ CapturableCandidate( const game_info_t *game, const int id )
 //  すぐに捕まる手かどうかを判定  //
 ////////////////////////////////////
 bool
-IsDeadlyExtension( const game_info_t *game, const int color, const int id )
+IsDeadlyExtension( game_info_t *game, const int color, const int id )
 {
-  game_info_t search_game;
   const int other = FLIP_COLOR(color);
   int pos = game->string[id].lib[0];
+  bool deadly;
 
   if (nb4_empty[Pat3(game->pat, pos)] == 0 &&
       IsSuicide(game, game->string, other, pos)) {
     return true;
   }
 
-  CopyGame(&search_game, game);
-  PutStone(&search_game, pos, other);
+  BeginUndo(game);
+  PutStone(game, pos, other);
 
-  if (search_game.string[search_game.string_id[pos]].libs == 1) {
-    return true;
-  } else {
-    return false;
-  }
+  deadly = (game->string[game->string_id[pos]].libs == 1);
+
+  Undo(game);
+  EndUndo(game);
+
+  return deadly;
 }
 
 
@@ -170,34 +171,36 @@ IsDeadlyExtension( const game_info_t *game, const int color, const int id )
 //  自己アタリになるトリか判定  //
 /////////////////////////////////
 bool
-IsSelfAtariCapture( const game_info_t *game, const int pos, const int color, const int id )
+IsSelfAtariCapture( game_info_t *game, const int pos, const int color, const int id )
 {
   string_t *string;
   const int string_pos = game->string[id].origin;
   int *string_id;
+  bool self_atari;
 
   if (!IsLegal(game, pos, color)) {
     return false;
   }
 
-  CopyGame(&capture_game, game);
-  PutStone(&capture_game, pos, color);
+  BeginUndo(game);
+  PutStone(game, pos, color);
 
-  string = capture_game.string;
-  string_id = capture_game.string_id;
+  string = game->string;
+  string_id = game->string_id;
 
-  if (string[string_id[string_pos]].libs == 1) {
-    return true;
-  } else {
-    return false;
-  }
+  self_atari = (string[string_id[string_pos]].libs == 1);
+
+  Undo(game);
+  EndUndo(game);
+
+  return self_atari;
 }
 
 ////////////////////////////////////////
 //  呼吸点がどのように変化するかを確認  //
 ////////////////////////////////////////
 int
-CheckLibertyState( const game_info_t *game, const int pos, const int color, const int id )
+CheckLibertyState( game_info_t *game, const int pos, const int color, const int id )
 {
   string_t *string;
   const int string_pos = game->string[id].origin;
@@ -209,14 +212,17 @@ CheckLibertyState( const game_info_t *game, const int pos, const int color, cons
     return L_DECREASE;
   }
 
-  CopyGame(&liberty_game, game);
-  PutStone(&liberty_game, pos, color);
+  BeginUndo(game);
+  PutStone(game, pos, color);
 
-  string = liberty_game.string;
-  string_id = liberty_game.string_id;
+  string = game->string;
+  string_id = game->string_id;
 
   new_libs = string[string_id[string_pos]].libs;
 
+  Undo(game);
+  EndUndo(game);
+
   if (new_libs > libs + 1) {
     return L_INCREASE;
   } else if (new_libs > libs) {
@@ -10,23 +10,26 @@ enum LIBERTY_STATE {
 };
 
 
+// gameを取る判定は盤面に石を置いて調べ, Undoで元に戻す
+// (その間はgameが変わる)
+
 //  1手で取れるアタリの判定
-bool IsCapturableAtari( const game_info_t *game, const int pos, const int color, const int opponent_pos );
+bool IsCapturableAtari( game_info_t *game, const int pos, const int color, const int opponent_pos );
 
 //  オイオトシの確認
-int CheckOiotoshi( const game_info_t *game, const int pos, const int color, const int opponent_pos );
+int CheckOiotoshi( game_info_t *game, const int pos, const int color, const int opponent_pos );
 
 //  ウッテガエシ用の判定
 int CapturableCandidate( const game_info_t *game, const int id );
 
 //  すぐに捕まる手かどうかを判定  
-bool IsDeadlyExtension( const game_info_t *game, const int color, const int id );
+bool IsDeadlyExtension( game_info_t *game, const int color, const int id );
 
 //  呼吸点がどのように変化するかを確認
-int CheckLibertyState( const game_info_t *game, const int pos, const int color, const int id );
+int CheckLibertyState( game_info_t *game, const int pos, const int color, const int id );
 
 //  自己アタリになるトリかどうか判定
-bool IsSelfAtariCapture( const game_info_t *game, const int pos, const int color, const int id );
+bool IsSelfAtariCapture( game_info_t *game, const int pos, const int color, const int id );
 
 //  1手で取れるアタリ(シミュレーション用)
 bool IsCapturableAtariForSimulation( const game_info_t *game, const int pos, const int color, const int id );
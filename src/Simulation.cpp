@@ -1,28 +1,131 @@
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <random>
+#include <vector>
 
 #include "GoBoard.h"
 #include "Message.h"
 #include "MoveCache.h"
+#include "PlayoutStat.h"
 #include "Point.h"
 #include "Rating.h"
 #include "Simulation.h"
+#include "Utility.h"
 
 using namespace std;
 
 
-////////////////////////////////
-//  終局までシミュレーション  //
-////////////////////////////////
+//////////////////////////////////////////////////////////
+//  プレイアウト開始時のレートのキャッシュ              //
+//                                                      //
+//  探索木の葉は展開されるまで何度もシミュレーション    //
+//  されるので, 着手列のハッシュ値毎にRatingの結果      //
+//  (レート, 戦術的特徴, 候補手のフラグ)を覚えておく.   //
+//  着手列が同じならセキの情報も同じになる.              //
+//  ノードの評価で付いた戦術的特徴は消してから計算する   //
+//////////////////////////////////////////////////////////
+struct rating_cache_t {
+  unsigned long long move_hash;     // 着手列のハッシュ値
+  unsigned long long current_hash;  // 局面のハッシュ値
+  int moves;                        // 手数 (0なら未使用)
+  long long sum_rate[2];
+  long long sum_rate_row[2][BOARD_SIZE];
+  long long rate[2][PURE_BOARD_MAX];
+  unsigned int tactical_features1[PURE_BOARD_MAX];
+  unsigned int tactical_features2[PURE_BOARD_MAX];
+  bool candidates[PURE_BOARD_MAX];
+};
+
+// キャッシュのエントリ数 (2のべき乗)
+const int RATING_CACHE_SIZE = 256;
+
+// 探索のスレッド毎に持つ
+static thread_local vector<rating_cache_t> rating_cache;
+
+// 盤上の石数の差がこれ以上になったら打ち切る (0なら打ち切らない)
+static int mercy_threshold = 0;
+
+
+//////////////////////////////
+//  打ち切りの閾値の設定    //
+//////////////////////////////
 void
-Simulation(game_info_t *game, int starting_color, std::mt19937_64 *mt, LGR& lgr, LGRContext& ctx)
+SetMercyThreshold( int threshold )
 {
-  int color = starting_color, pos = -1, pass_count = (game->record[game->moves - 1].pos == PASS && game->moves > 1);
+  mercy_threshold = threshold;
+}
 
-  // シミュレーション打ち切り手数を設定
-  int length = MAX_MOVES - game->moves;
-  if (length < 0) {
-    return;
+
+//////////////////////////////////////////////////////
+//  盤上の石数の差(黒−白)から取った石の差を除いた値  //
+//  (着手毎に±1して取った石の差を足せば石数の差)    //
+//////////////////////////////////////////////////////
+static int
+StoneDifferenceBase( const game_info_t *game )
+{
+  int diff = 0;
+
+  for (int i = 0; i < pure_board_max; i++) {
+    const int c = game->board[onboard_pos[i]];
+    if (c == S_BLACK) {
+      diff++;
+    } else if (c == S_WHITE) {
+      diff--;
+    }
+  }
+
+  return diff - (game->prisoner[S_BLACK] - game->prisoner[S_WHITE]);
+}
+
+
+//////////////////////////////////////////
+//  石数の差で勝敗が決まったかの判定    //
+//////////////////////////////////////////
+static inline bool
+IsMercy( const game_info_t *game, const int base )
+{
+  return abs(base + game->prisoner[S_BLACK] - game->prisoner[S_WHITE]) >= mercy_threshold;
+}
+
+
+////////////////////////////////////
+//  プレイアウト開始時のレート    //
+////////////////////////////////////
+static void
+InitializeRate( game_info_t *game, bool use_cache )
+{
+  rating_cache_t *cache = nullptr;
+
+  if (use_cache) {
+    if (rating_cache.empty()) {
+      rating_cache.resize(RATING_CACHE_SIZE);
+    }
+    cache = &rating_cache[game->move_hash & (RATING_CACHE_SIZE - 1)];
+
+    // 同じ葉のレートが残っていればそれを使う
+    if (cache->moves == game->moves &&
+        cache->move_hash == game->move_hash &&
+        cache->current_hash == game->current_hash) {
+      copy_n(cache->sum_rate, 2, game->sum_rate);
+      copy(cache->sum_rate_row[0], cache->sum_rate_row[2], game->sum_rate_row[0]);
+      for (int i = 0; i < pure_board_max; i++) {
+        const int pos = onboard_pos[i];
+        game->rate[0][pos] = cache->rate[0][i];
+        game->rate[1][pos] = cache->rate[1][i];
+        game->tactical_features1[pos] = cache->tactical_features1[i];
+        game->tactical_features2[pos] = cache->tactical_features2[i];
+        game->candidates[pos] = cache->candidates[i];
+      }
+      return;
+    }
+
+    // 探索木の中で付いた戦術的特徴を消してから計算する
+    for (int i = 0; i < pure_board_max; i++) {
+      const int pos = onboard_pos[i];
+      game->tactical_features1[pos] = 0;
+      game->tactical_features2[pos] = 0;
+    }
   }
 
   // レートの初期化  
@@ -35,6 +138,46 @@ Simulation(game_info_t *game, int starting_color, std::mt19937_64 *mt, LGR& lgr,
   // 白番のレートの計算
   Rating(game, S_WHITE, &game->sum_rate[1], game->sum_rate_row[1], game->rate[1]);
 
+  if (cache != nullptr) {
+    cache->move_hash = game->move_hash;
+    cache->current_hash = game->current_hash;
+    cache->moves = game->moves;
+    copy_n(game->sum_rate, 2, cache->sum_rate);
+    copy(game->sum_rate_row[0], game->sum_rate_row[2], cache->sum_rate_row[0]);
+    for (int i = 0; i < pure_board_max; i++) {
+      const int pos = onboard_pos[i];
+      cache->rate[0][i] = game->rate[0][pos];
+      cache->rate[1][i] = game->rate[1][pos];
+      cache->tactical_features1[i] = game->tactical_features1[pos];
+      cache->tactical_features2[i] = game->tactical_features2[pos];
+      cache->candidates[i] = game->candidates[pos];
+    }
+  }
+}
+
+
+////////////////////////////////
+//  終局までシミュレーション  //
+////////////////////////////////
+void
+Simulation(game_info_t *game, int starting_color, std::mt19937_64 *mt, LGR& lgr, LGRContext& ctx, bool use_cache)
+{
+  int color = starting_color, pos = -1, pass_count = (game->record[game->moves - 1].pos == PASS && game->moves > 1);
+
+  // シミュレーション打ち切り手数を設定
+  int length = MAX_MOVES - game->moves;
+  if (length < 0) {
+    return;
+  }
+
+  const ray_clock::time_point start_time = PlayoutStatClock();
+  const int start_moves = game->moves;
+
+  // 黒番と白番のレートの計算
+  InitializeRate(game, use_cache);
+
+  int stone_diff = (mercy_threshold > 0) ? StoneDifferenceBase(game) : 0;
+
   // 終局まで対局をシミュレート
   while (length-- && pass_count < 2) {
     // 着手を生成する
@@ -45,9 +188,104 @@ Simulation(game_info_t *game, int starting_color, std::mt19937_64 *mt, LGR& lgr,
     PoPutStone(game, pos, color);
     // パスの確認
     pass_count = (pos == PASS) ? (pass_count + 1) : 0;
+    // 石数の差が開いたら打ち切る
+    if (mercy_threshold > 0 && pos != PASS) {
+      stone_diff += (color == S_BLACK) ? 1 : -1;
+      if (IsMercy(game, stone_diff)) {
+        CountPlayoutStat(PO_MERCY, 1);
+        break;
+      }
+    }
     // 手番の入れ替え
     color = FLIP_COLOR(color);
   }
+
+  CountPlayoutStat(PO_PLAYOUTS, 1);
+  CountPlayoutStat(PO_MOVES, game->moves - start_moves);
+  CountPlayoutStatTime(PO_PLAYOUT_TIME, start_time);
+}
+
+
+////////////////////////////////////////////
+//  パターンの差分更新の速度の計測        //
+//                                        //
+//  現在の局面からランダムに終局まで打ち, //
+//  石を置いた点と取り除いた点を記録して, //
+//  パターンの更新だけを打ち直す           //
+////////////////////////////////////////////
+void
+BenchmarkPatternUpdate( const game_info_t *game, int color, int games, long long *stones, long long *removals, double *stone_ns, double *removal_ns )
+{
+  mt19937_64 mt(random_device{}());
+  game_info_t *sim_game = AllocateGame();
+  vector<pattern_t> pat(board_max);
+  vector<vector<int>> stone_pos(games), stone_color(games), removal_pos(games);
+  char board[BOARD_MAX];
+
+  *stones = 0;
+  *removals = 0;
+
+  // 着手とトリの記録
+  for (int n = 0; n < games; n++) {
+    int c = color, pass_count = 0;
+    CopyGame(sim_game, game);
+    while (pass_count < 2 && sim_game->moves < MAX_RECORDS - 1) {
+      int pos = PASS;
+      for (int i = 0; i < 100; i++) {
+        const int p = onboard_pos[mt() % pure_board_max];
+        if (IsLegalNotEye(sim_game, p, c)) {
+          pos = p;
+          break;
+        }
+      }
+      if (pos == PASS) {
+        PutStone(sim_game, PASS, c);
+        pass_count++;
+        c = FLIP_COLOR(c);
+        continue;
+      }
+      pass_count = 0;
+      memcpy(board, sim_game->board, sizeof(board));
+      PutStone(sim_game, pos, c);
+      stone_pos[n].push_back(pos);
+      stone_color[n].push_back(c);
+      for (int i = 0; i < pure_board_max; i++) {
+        const int p = onboard_pos[i];
+        if (board[p] != S_EMPTY && sim_game->board[p] == S_EMPTY) {
+          removal_pos[n].push_back(p);
+        }
+      }
+      c = FLIP_COLOR(c);
+    }
+    *stones += stone_pos[n].size();
+    *removals += removal_pos[n].size();
+  }
+
+  // 石を置いた時の更新
+  double elapsed = 0.0;
+  for (int n = 0; n < games; n++) {
+    memcpy(pat.data(), game->pat, sizeof(pattern_t) * board_max);
+    const ray_clock::time_point start_time = ray_clock::now();
+    for (size_t i = 0; i < stone_pos[n].size(); i++) {
+      UpdatePatternStone(pat.data(), stone_color[n][i], stone_pos[n][i]);
+    }
+    elapsed += chrono::duration<double, nano>(ray_clock::now() - start_time).count();
+  }
+  *stone_ns = *stones > 0 ? elapsed / *stones : 0.0;
+
+  // 石を取り除いた時の更新
+  elapsed = 0.0;
+  for (int n = 0; n < games; n++) {
+    memcpy(pat.data(), game->pat, sizeof(pattern_t) * board_max);
+    const ray_clock::time_point start_time = ray_clock::now();
+    for (const int pos : removal_pos[n]) {
+      UpdatePatternEmpty(pat.data(), pos);
+    }
+    elapsed += chrono::duration<double, nano>(ray_clock::now() - start_time).count();
+  }
+  *removal_ns = *removals > 0 ? elapsed / *removals : 0.0;
+
+  FreeGame(sim_game);
 }
 
 ////////////////////////////////
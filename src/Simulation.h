@@ -8,8 +8,15 @@
 class LGR;
 class LGRContext;
 
+// 盤上の石数の差がthreshold以上になったらシミュレーションを打ち切る (0なら打ち切らない)
+void SetMercyThreshold( int threshold );
+
 // 対局のシミュレーション(知識あり)
-void Simulation( game_info_t *game, int color, std::mt19937_64 *mt, LGR& lgrf, LGRContext& ctx );
+// use_cacheなら開始局面のレートを着手列毎にキャッシュする
+void Simulation( game_info_t *game, int color, std::mt19937_64 *mt, LGR& lgrf, LGRContext& ctx, bool use_cache );
+
+// games局ランダムに打った時のパターンの更新1回の時間(ns)を, 石を置いた時と取り除いた時に分けて測る
+void BenchmarkPatternUpdate( const game_info_t *game, int color, int games, long long *stones, long long *removals, double *stone_ns, double *removal_ns );
 
 int SimulationGenmove(game_info_t *game, int color);
 
@@ -4,10 +4,12 @@
 #include <string>
 #include <cstdio>
 #include <iostream>
+#include <vector>
 
 #include "Ladder.h"
 #include "Message.h"
 #include "Nakade.h"
+#include "ParamImage.h"
 #include "PatternHash.h"
 #include "Point.h"
 #include "Semeai.h"
@@ -35,26 +37,31 @@ static latent_factor_t uct_move_distance_2[MOVE_DISTANCE_MAX];
 // 3x3パターンのレート
 static latent_factor_t uct_pat3[PAT3_LIMIT];
 // マンハッタン距離2のパターンのレート
-static latent_factor_t uct_md2[MD2_LIMIT];
+static const latent_factor_t *uct_md2;
 // マンハッタン距離3のパターンのレート
-static latent_factor_t uct_md3[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md3;
 // マンハッタン距離4のパターンのレート
-static latent_factor_t uct_md4[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md4;
 // マンハッタン距離5のパターンのレート
-static latent_factor_t uct_md5[LARGE_PAT_MAX];
+static const latent_factor_t *uct_md5;
 // オーナーのレート
 double uct_owner[OWNER_MAX];
 // クリティカリティのレート
 double uct_criticality[CRITICALITY_MAX];
 
-index_hash_t md3_index[HASH_MAX];
-index_hash_t md4_index[HASH_MAX];
-index_hash_t md5_index[HASH_MAX];
+pattern_index_t md3_index;
+pattern_index_t md4_index;
+pattern_index_t md5_index;
 
 static int pat3_index[PAT3_MAX];
-static int md2_index[MD2_MAX];
+static const int *md2_index;
+
+// 大きな表はイメージを指す
+// テキストから読み込んだ時は以下の実体を指す
+static vector<latent_factor_t> uct_md2_table, uct_md3_table, uct_md4_table, uct_md5_table;
+static vector<pattern_bucket_t> md3_index_table, md4_index_table, md5_index_table;
+static vector<int> md2_index_table;
 
-static game_info_t snapback_game;
 
 
 // 戦術的特徴のビットマスク
@@ -92,9 +99,9 @@ static void InputLatentFactor( const char *filename, latent_factor_t *lf, int n
 //  読み込み Pat3
 static void InputPat3( const char *filename, latent_factor_t *lf );
 //  読み込み MD2
-static void InputMD2( const char *filename, latent_factor_t *lf );
+static void InputMD2( const char *filename, latent_factor_t *lf, int *pat_index );
 //  読み込み
-static void InputLargePattern( const char *filename, latent_factor_t *lf, index_hash_t *pat_index );
+static void InputLargePattern( const char *filename, latent_factor_t *lf, vector<pattern_bucket_t> &bucket, pattern_index_t *pat_index );
 
 
 //////////////////////
@@ -120,7 +127,7 @@ InitializeUctRating()
 //  呼吸点が1つの連に対する特徴の判定  //
 /////////////////////////////////////////
 void
-UctCheckFeaturesLib1( const game_info_t *game, int color, int id, bool ladder, uct_features_t *uct_features )
+UctCheckFeaturesLib1( game_info_t *game, int color, int id, bool ladder, uct_features_t *uct_features )
 {
   const string_t *string = game->string;
   int lib, neighbor;
@@ -191,7 +198,7 @@ UctCheckFeaturesLib1( const game_info_t *game, int color, int id, bool ladder, u
 //  呼吸点が2つの連に対する特徴の判定  //
 /////////////////////////////////////////
 void
-UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t *uct_features )
+UctCheckFeaturesLib2( game_info_t *game, int color, int id, uct_features_t *uct_features )
 {
   const string_t *string = game->string;
   int lib1, lib2, neighbor, lib1_state, lib2_state;
@@ -321,7 +328,7 @@ UctCheckFeaturesLib2( const game_info_t *game, int color, int id, uct_features_t
 //  呼吸点が3つの連に対する特徴の判定  //
 /////////////////////////////////////////
 void
-UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t *uct_features )
+UctCheckFeaturesLib3( game_info_t *game, int color, int id, uct_features_t *uct_features )
 {
   const string_t *string = game->string;
   int lib1, lib2, lib3, neighbor, lib1_state, lib2_state, lib3_state;
@@ -496,7 +503,7 @@ UctCheckFeaturesLib3( const game_info_t *game, int color, int id, uct_features_t
 //  特徴の判定  //
 //////////////////
 void
-UctCheckFeatures( const game_info_t *game, int color, uct_features_t *uct_features )
+UctCheckFeatures( game_info_t *game, int color, uct_features_t *uct_features )
 { 
   const char *board = game->board;
   const string_t *string = game->string;
@@ -709,7 +716,7 @@ UctCheckCapture( const game_info_t *game, int color, int pos, uct_features_t *uc
 //  アタリの判定  //
 ////////////////////
 void
-UctCheckAtari( const game_info_t *game, int color, int pos, uct_features_t *uct_features )
+UctCheckAtari( game_info_t *game, int color, int pos, uct_features_t *uct_features )
 {
   const char *board = game->board;
   const int other = FLIP_COLOR(color);
@@ -1016,11 +1023,24 @@ UctCheckDoubleKeima( const game_info_t *game, int color, int pos, uct_features_t
 }
 
 
+////////////////////////////////////////
+//  取り返してウッテガエシになるか確認  //
+////////////////////////////////////////
+static bool
+IsSnapBack( const game_info_t *game, const int pos )
+{
+  const int id = game->string_id[pos];
+  const int lib = game->string[id].lib[0];
+
+  return lib == CapturableCandidate(game, id);
+}
+
+
 ////////////////////
 //  ウッテガエシ  //
 ////////////////////
 void
-UctCheckSnapBack( const game_info_t *game, int color, int pos, uct_features_t *uct_features )
+UctCheckSnapBack( game_info_t *game, int color, int pos, uct_features_t *uct_features )
 {
   const string_t *string = game->string;
   const int *string_id = game->string_id;
@@ -1035,20 +1055,20 @@ UctCheckSnapBack( const game_info_t *game, int color, int pos, uct_features_t *u
     if (board[neighbor4[i]] == other) {
       int id = string_id[neighbor4[i]];
 
-      const game_info_t *check_game;
+      bool snapback;
       if (string[id].libs == 1) {
-        check_game = game;
+        snapback = IsSnapBack(game, neighbor4[i]);
       } else if (string[id].libs == 2) {
-        CopyGame(&snapback_game, game);
-        PutStone(&snapback_game, pos, color);
-        check_game = &snapback_game;
+        // 石を置いて確認してから元に戻す
+        BeginUndo(game);
+        PutStone(game, pos, color);
+        snapback = IsSnapBack(game, neighbor4[i]);
+        Undo(game);
+        EndUndo(game);
       } else {
         continue;
       }
-      int id2 = check_game->string_id[neighbor4[i]];
-      int lib = check_game->string[id2].lib[0];
-      int capturable_pos = CapturableCandidate(check_game, id2);
-      if (lib == capturable_pos) {
+      if (snapback) {
         tactical_features1[pos] |= uct_mask[UCT_SNAPBACK];
         return;
       }
@@ -1057,33 +1077,22 @@ UctCheckSnapBack( const game_info_t *game, int color, int pos, uct_features_t *u
 }
 
 
-double
-CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_t *uct_features )
+//////////////////////////////////////////////
+//  着手の特徴を集める (特徴の数を返す)     //
+//////////////////////////////////////////////
+static int
+CollectLFRFeatures( const game_info_t *game, int pos, const int index[3], const uct_features_t *uct_features, const latent_factor_t *all_feature[] )
 {
   const int moves = game->moves;
   const pattern_t *pat = game->pat;
   int pm1 = PASS, pm2 = PASS;
   int dis1 = -1, dis2 = -1;
-  double score = weight_zero;
-  double tmp_score;
-  unsigned long long *tactical_features1 = uct_features->tactical_features1;
   unsigned int pat3, md2;
-  latent_factor_t *all_feature[UCT_TACTICAL_FEATURE_MAX + 6];
   int feature_num = 0;
 
   if (moves > 1) pm1 = game->record[moves - 1].pos;
   if (moves > 2) pm2 = game->record[moves - 2].pos;
 
-  // パスの時の分岐
-  if (pos == PASS) {
-    if (moves > 1 && pm1 == PASS) {
-      score += uct_pass[UCT_PASS_AFTER_PASS].w;
-    } else {
-      score += uct_pass[UCT_PASS_AFTER_MOVE].w;
-    }
-    return score;
-  }
-
   if (moves > 1 && pm1 != PASS) {
     dis1 = DIS(pm1, pos);
     if (dis1 >= MOVE_DISTANCE_MAX - 1) {
@@ -1101,11 +1110,13 @@ CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_
   pat3 = pat3_index[Pat3(pat, pos)];
   md2 = md2_index[MD2(pat, pos)];
 
-  // 特徴を
-  for (int i = 0; i < UCT_TACTICAL_FEATURE_MAX; i++) {
-    if ((tactical_features1[pos] & uct_mask[i]) != 0) {
-      all_feature[feature_num++] = &uct_tactical_features[i];
+  // 戦術的特徴 (立っているビットだけ見る)
+  for (unsigned long long bits = uct_features->tactical_features1[pos]; bits != 0; bits &= bits - 1) {
+    const int i = LowestBit(bits);
+    if (i >= UCT_TACTICAL_FEATURE_MAX) {
+      break;
     }
+    all_feature[feature_num++] = &uct_tactical_features[i];
   }
   // 盤上の位置
   all_feature[feature_num++] = &uct_pos_id[board_pos_id[pos]];
@@ -1115,7 +1126,7 @@ CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_
   }
   // 2手前からの距離
   if (dis2 != -1) {
-    all_feature[feature_num++] = &uct_move_distance_2[dis2];	
+    all_feature[feature_num++] = &uct_move_distance_2[dis2];
   }
   // パターン
   if (index[2] != -1) {
@@ -1130,34 +1141,89 @@ CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_
     all_feature[feature_num++] = &uct_pat3[pat3];
   }
 
-  // wの足し算
+  return feature_num;
+}
+
+
+////////////////////////////////////////////////
+//  集めた特徴からレートを計算               //
+//  Σ_{i<j} <v_i, v_j> = ((Σv)^2 - Σv^2) / 2  //
+//  で2次の項を特徴の数に比例する時間で求める  //
+////////////////////////////////////////////////
+static double
+LFRScore( const latent_factor_t *const all_feature[], const int feature_num )
+{
+  double score = weight_zero;
+  double sum[LFR_DIMENSION] = { 0.0 }, square[LFR_DIMENSION] = { 0.0 };
+
   for (int i = 0; i < feature_num; i++) {
-    score += all_feature[i]->w;
+    const latent_factor_t *feature = all_feature[i];
+    score += feature->w;
+    for (int f = 0; f < LFR_DIMENSION; f++) {
+      sum[f] += feature->v[f];
+      square[f] += feature->v[f] * feature->v[f];
+    }
   }
 
-  // vの計算
   for (int f = 0; f < LFR_DIMENSION; f++) {
-    for (int i = 0; i < feature_num; i++) {
-      tmp_score = 0.0;
-      for (int j = i + 1; j < feature_num; j++) {
-	tmp_score += all_feature[j]->v[f];
-      }
-      score += tmp_score * all_feature[i]->v[f];
-    }
+    score += 0.5 * (sum[f] * sum[f] - square[f]);
   }
 
   return score;
 }
 
 
+double
+CalculateLFRScore( const game_info_t *game, int pos, int index[3], uct_features_t *uct_features )
+{
+  const latent_factor_t *all_feature[UCT_TACTICAL_FEATURE_MAX + 6];
+
+  // パスの時の分岐
+  if (pos == PASS) {
+    const int moves = game->moves;
+    if (moves > 1 && game->record[moves - 1].pos == PASS) {
+      return weight_zero + uct_pass[UCT_PASS_AFTER_PASS].w;
+    } else {
+      return weight_zero + uct_pass[UCT_PASS_AFTER_MOVE].w;
+    }
+  }
+
+  return LFRScore(all_feature, CollectLFRFeatures(game, pos, index, uct_features, all_feature));
+}
+
+
+////////////////////////////////////////////////////
+//  複数の着手のレートをまとめて計算              //
+//  先に全ての着手の特徴を集めてから計算するので, //
+//  表の読み込みが続けて出せる                    //
+////////////////////////////////////////////////////
+void
+CalculateLFRScores( const game_info_t *game, const int num, const int pos[], const int index[][3], const uct_features_t *uct_features, double score[] )
+{
+  const int block = 16;
+  const latent_factor_t *all_feature[block][UCT_TACTICAL_FEATURE_MAX + 6];
+  int feature_num[block];
+
+  for (int start = 0; start < num; start += block) {
+    const int end = (start + block < num) ? start + block : num;
+
+    for (int i = start; i < end; i++) {
+      feature_num[i - start] = CollectLFRFeatures(game, pos[i], index[i], uct_features, all_feature[i - start]);
+    }
+    for (int i = start; i < end; i++) {
+      score[i] = LFRScore(all_feature[i - start], feature_num[i - start]);
+    }
+  }
+}
+
+
 //////////////////////////////////////////
 //  着手予想の精度を確認するための関数  //
 //////////////////////////////////////////
 void
-AnalyzeUctRating( const game_info_t *game, int color, double rate[] )
+AnalyzeUctRating( game_info_t *game, int color, double rate[] )
 {
   const int moves = game->moves;
-  int pat_index[3];
   pattern_hash_t hash_pat;
   uct_features_t uct_features;
 
@@ -1171,10 +1237,14 @@ AnalyzeUctRating( const game_info_t *game, int color, double rate[] )
     UctCheckKoConnection(game, &uct_features);
   }
 
+  int num = 0;
+  int pos_list[PURE_BOARD_MAX], rate_index[PURE_BOARD_MAX], pat_index[PURE_BOARD_MAX][3];
+  double score[PURE_BOARD_MAX];
+
   for (int i = 0; i < pure_board_max; i++) {
     const int pos = onboard_pos[i];
+    rate[i] = 0;
     if (!game->candidates[pos] || !IsLegal(game, pos, color)) {
-      rate[i] = 0;
       continue;
     }
 
@@ -1187,11 +1257,17 @@ AnalyzeUctRating( const game_info_t *game, int color, double rate[] )
 
     //  Pattern
     PatternHash(&game->pat[pos], &hash_pat);
-    pat_index[0] = SearchIndex(md3_index, hash_pat.list[MD_3]);
-    pat_index[1] = SearchIndex(md4_index, hash_pat.list[MD_4]);
-    pat_index[2] = SearchIndex(md5_index, hash_pat.list[MD_5 + MD_MAX]);
+    pat_index[num][0] = SearchIndex(md3_index, hash_pat.list[MD_3]);
+    pat_index[num][1] = SearchIndex(md4_index, hash_pat.list[MD_4]);
+    pat_index[num][2] = SearchIndex(md5_index, hash_pat.list[MD_5 + MD_MAX]);
+    pos_list[num] = pos;
+    rate_index[num] = i;
+    num++;
+  }
 
-    rate[i] = CalculateLFRScore(game, pos, pat_index, &uct_features);
+  CalculateLFRScores(game, num, pos_list, pat_index, &uct_features, score);
+  for (int i = 0; i < num; i++) {
+    rate[rate_index[i]] = score[i];
   }
 }
 
@@ -1202,7 +1278,6 @@ void
 InputUCTParameter(void)
 {
   string uct_parameters_path = uct_params_path;
-  string path;
 
 #if defined (_WIN32)
   uct_parameters_path += '\\';
@@ -1210,50 +1285,129 @@ InputUCTParameter(void)
   uct_parameters_path += '/';
 #endif
 
-  path = uct_parameters_path + "WeightZero.txt";
+  const vector<string> sources = {
+    uct_parameters_path + "WeightZero.txt",
+    uct_parameters_path + "TacticalFeature.txt",
+    uct_parameters_path + "PosID.txt",
+    uct_parameters_path + "Pass.txt",
+    uct_parameters_path + "MoveDistance1.txt",
+    uct_parameters_path + "MoveDistance2.txt",
+    uct_parameters_path + "Pat3.txt",
+    uct_parameters_path + "MD2.txt",
+    uct_parameters_path + "MD3.txt",
+    uct_parameters_path + "MD4.txt",
+    uct_parameters_path + "MD5.txt",
+  };
+
+  // イメージに入れる表 (順番がイメージの区画の並びになる)
+  // 小さな表は大域変数にコピーし, 大きな表はイメージを直接指す
+  struct {
+    void *copy;
+    const void **map;
+    size_t size;
+  } table[] = {
+    { &weight_zero,          nullptr,                         sizeof(weight_zero) },
+    { uct_tactical_features, nullptr,                         sizeof(uct_tactical_features) },
+    { uct_pos_id,            nullptr,                         sizeof(uct_pos_id) },
+    { uct_pass,              nullptr,                         sizeof(uct_pass) },
+    { uct_move_distance_1,   nullptr,                         sizeof(uct_move_distance_1) },
+    { uct_move_distance_2,   nullptr,                         sizeof(uct_move_distance_2) },
+    { uct_pat3,              nullptr,                         sizeof(uct_pat3) },
+    { pat3_index,            nullptr,                         sizeof(pat3_index) },
+    { nullptr,               (const void **)&uct_md2,         sizeof(latent_factor_t) * MD2_LIMIT },
+    { nullptr,               (const void **)&md2_index,       sizeof(int) * MD2_MAX },
+    { nullptr,               (const void **)&uct_md3,         sizeof(latent_factor_t) * LARGE_PAT_MAX },
+    { nullptr,               (const void **)&uct_md4,         sizeof(latent_factor_t) * LARGE_PAT_MAX },
+    { nullptr,               (const void **)&uct_md5,         sizeof(latent_factor_t) * LARGE_PAT_MAX },
+  };
+  const int sections = (int)(sizeof(table) / sizeof(table[0]));
+
+  // 大きなパターンのインデックス
+  // (バケットの数が変わるので, マスクとバケットの2区画を表の後に置く)
+  pattern_index_t *pattern_index[] = { &md3_index, &md4_index, &md5_index };
+  const int pattern_indexes = (int)(sizeof(pattern_index) / sizeof(pattern_index[0]));
+
+  // 前回作ったイメージがあればそのまま使う
+  ParamImage image(uct_parameters_path + "UctParamImage.bin", sources);
+  bool loaded = image.Load(sections + pattern_indexes * 2);
+
+  for (int i = 0; i < sections && loaded; i++) {
+    loaded = image.Section(i, table[i].size) != nullptr;
+  }
+  for (int i = 0; i < pattern_indexes && loaded; i++) {
+    const unsigned int *mask = (const unsigned int *)image.Section(sections + i * 2, sizeof(unsigned int));
+    loaded = mask != nullptr &&
+      image.Section(sections + i * 2 + 1, sizeof(pattern_bucket_t) * ((size_t)*mask + 1)) != nullptr;
+  }
+
+  if (loaded) {
+    for (int i = 0; i < sections; i++) {
+      if (table[i].copy != nullptr) {
+        memcpy(table[i].copy, image.Section(i, table[i].size), table[i].size);
+      } else {
+        *table[i].map = image.Section(i, table[i].size);
+      }
+    }
+    for (int i = 0; i < pattern_indexes; i++) {
+      pattern_index[i]->mask = *(const unsigned int *)image.Section(sections + i * 2, sizeof(unsigned int));
+      pattern_index[i]->bucket = (const pattern_bucket_t *)image.Section(sections + i * 2 + 1, sizeof(pattern_bucket_t) * ((size_t)pattern_index[i]->mask + 1));
+    }
+  } else {
+    uct_md2_table.assign(MD2_LIMIT, latent_factor_t());
+    uct_md3_table.assign(LARGE_PAT_MAX, latent_factor_t());
+    uct_md4_table.assign(LARGE_PAT_MAX, latent_factor_t());
+    uct_md5_table.assign(LARGE_PAT_MAX, latent_factor_t());
+    md2_index_table.assign(MD2_MAX, -1);
 
-  //  W_0
-  InputTxtDBL(path.c_str(), &weight_zero, 1);
+    //  W_0
+    InputTxtDBL(sources[0].c_str(), &weight_zero, 1);
 
-  //  戦術的特徴
-  path = uct_parameters_path + "TacticalFeature.txt";
-  InputLatentFactor(path.c_str(), uct_tactical_features, UCT_TACTICAL_FEATURE_MAX);
+    //  戦術的特徴
+    InputLatentFactor(sources[1].c_str(), uct_tactical_features, UCT_TACTICAL_FEATURE_MAX);
 
-  // 盤上の位置
-  path = uct_parameters_path + "PosID.txt";
-  InputLatentFactor(path.c_str(), uct_pos_id, POS_ID_MAX);
+    // 盤上の位置
+    InputLatentFactor(sources[2].c_str(), uct_pos_id, POS_ID_MAX);
 
-  // パス
-  path = uct_parameters_path + "Pass.txt";
-  InputLatentFactor(path.c_str(), uct_pass, UCT_PASS_MAX);
+    // パス
+    InputLatentFactor(sources[3].c_str(), uct_pass, UCT_PASS_MAX);
 
-  //  直前の手との距離
-  path = uct_parameters_path + "MoveDistance1.txt";
-  InputLatentFactor(path.c_str(), uct_move_distance_1, MOVE_DISTANCE_MAX);
+    //  直前の手との距離
+    InputLatentFactor(sources[4].c_str(), uct_move_distance_1, MOVE_DISTANCE_MAX);
 
-  //  2手前の手との距離
-  path = uct_parameters_path + "MoveDistance2.txt";
-  InputLatentFactor(path.c_str(), uct_move_distance_2, MOVE_DISTANCE_MAX);
+    //  2手前の手との距離
+    InputLatentFactor(sources[5].c_str(), uct_move_distance_2, MOVE_DISTANCE_MAX);
 
-  //  3x3パターン
-  path = uct_parameters_path + "Pat3.txt";
-  InputPat3(path.c_str(), uct_pat3);
+    //  3x3パターン
+    InputPat3(sources[6].c_str(), uct_pat3);
 
-  //  マンハッタン距離2のパターン
-  path = uct_parameters_path + "MD2.txt";
-  InputMD2(path.c_str(), uct_md2);
+    //  マンハッタン距離2のパターン
+    InputMD2(sources[7].c_str(), uct_md2_table.data(), md2_index_table.data());
 
-  //  マンハッタン距離3のパターン
-  path = uct_parameters_path + "MD3.txt";
-  InputLargePattern(path.c_str(), uct_md3, md3_index);
+    //  マンハッタン距離3のパターン
+    InputLargePattern(sources[8].c_str(), uct_md3_table.data(), md3_index_table, &md3_index);
 
-  //  マンハッタン距離4のパターン
-  path = uct_parameters_path + "MD4.txt";
-  InputLargePattern(path.c_str(), uct_md4, md4_index);
+    //  マンハッタン距離4のパターン
+    InputLargePattern(sources[9].c_str(), uct_md4_table.data(), md4_index_table, &md4_index);
 
-  //  マンハッタン距離5のパターン
-  path = uct_parameters_path + "MD5.txt";
-  InputLargePattern(path.c_str(), uct_md5, md5_index);
+    //  マンハッタン距離5のパターン
+    InputLargePattern(sources[10].c_str(), uct_md5_table.data(), md5_index_table, &md5_index);
+
+    uct_md2 = uct_md2_table.data();
+    uct_md3 = uct_md3_table.data();
+    uct_md4 = uct_md4_table.data();
+    uct_md5 = uct_md5_table.data();
+    md2_index = md2_index_table.data();
+
+    // 次回のためにイメージを書き出す (書けなくても続ける)
+    for (int i = 0; i < sections; i++) {
+      image.Add(table[i].copy != nullptr ? table[i].copy : *table[i].map, table[i].size);
+    }
+    for (int i = 0; i < pattern_indexes; i++) {
+      image.Add(&pattern_index[i]->mask, sizeof(unsigned int));
+      image.Add(pattern_index[i]->bucket, sizeof(pattern_bucket_t) * ((size_t)pattern_index[i]->mask + 1));
+    }
+    image.Save();
+  }
 
   //  Owner
   for (int i = 0; i < OWNER_MAX; i++) {
@@ -1390,7 +1544,7 @@ InputPat3( const char *filename, latent_factor_t *lf )
 //  γ読み込み MD2  //
 //////////////////////
 static void
-InputMD2( const char *filename, latent_factor_t *lf )
+InputMD2( const char *filename, latent_factor_t *lf, int *pat_index )
 {
   FILE *fp;
   int index, idx = 0;
@@ -1398,14 +1552,14 @@ InputMD2( const char *filename, latent_factor_t *lf )
   unsigned int md2_transp16[16];
 
   for (unsigned int md2 = 0; md2 < (unsigned int)MD2_MAX; md2++) {
-    md2_index[md2] = -1;
+    pat_index[md2] = -1;
   }
 
   for (unsigned int md2 = 0; md2 < (unsigned int)MD2_MAX; md2++) {
-    if (md2_index[md2] == -1) {
+    if (pat_index[md2] == -1) {
       MD2Transpose16(md2, md2_transp16);
       for (int i = 0; i < 16; i++) {
-	md2_index[md2_transp16[i]] = idx;
+	pat_index[md2_transp16[i]] = idx;
       }
       idx++;
     }
@@ -1419,7 +1573,7 @@ InputMD2( const char *filename, latent_factor_t *lf )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf_s(fp, "%d%lf", &index, &weight) != EOF) {
-    idx = md2_index[index];
+    idx = pat_index[index];
     lf[idx].w = weight;
     for (int i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf_s(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1434,7 +1588,7 @@ InputMD2( const char *filename, latent_factor_t *lf )
     cerr << "can not open -" << filename << "-" << endl;
   }
   while (fscanf(fp, "%d%lf", &index, &weight) != EOF) {
-    idx = md2_index[index];
+    idx = pat_index[index];
     lf[idx].w = weight;
     for (int i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1450,17 +1604,13 @@ InputMD2( const char *filename, latent_factor_t *lf )
 
 //  読み込み
 static void 
-InputLargePattern( const char *filename, latent_factor_t *lf, index_hash_t *pat_index )
+InputLargePattern( const char *filename, latent_factor_t *lf, vector<pattern_bucket_t> &bucket, pattern_index_t *pat_index )
 {
   FILE *fp;
   int index, idx = 0;
   unsigned long long hash;
   double weight;
-
-  for (int i = 0; i < HASH_MAX; i++) {
-    pat_index[i].hash = 0;
-    pat_index[i].index = -1;
-  }
+  vector<unsigned long long> pattern_hash;
 
 #if defined (_WIN32)
   errno_t err;
@@ -1471,8 +1621,7 @@ InputLargePattern( const char *filename, latent_factor_t *lf, index_hash_t *pat_
     exit(1);
   }
   while (fscanf_s(fp, "%d%llu%lf", &index, &hash, &weight) != EOF) {
-    pat_index[index].hash = hash;
-    pat_index[index].index = idx;
+    pattern_hash.push_back(hash);
     lf[idx].w = weight;
     for (int i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf_s(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1489,8 +1638,7 @@ InputLargePattern( const char *filename, latent_factor_t *lf, index_hash_t *pat_
     exit(1);
   }
   while (fscanf(fp, "%d%llu%lf", &index, &hash, &weight) != EOF) {
-    pat_index[index].hash = hash;
-    pat_index[index].index = idx;
+    pattern_hash.push_back(hash);
     lf[idx].w = weight;
     for (int i = 0; i < LFR_DIMENSION; i++) {
       if (fscanf(fp, "%lf", &lf[idx].v[i]) == EOF) {
@@ -1502,4 +1650,9 @@ InputLargePattern( const char *filename, latent_factor_t *lf, index_hash_t *pat_
   }
 #endif
   fclose(fp);
+
+  // ファイルの中の位置(index)は線形探索の表のものなので使わず,
+  // 読み込んだ順番をインデックスにして作り直す
+  pat_index->mask = MakePatternIndex(pattern_hash, bucket);
+  pat_index->bucket = bucket.data();
 }
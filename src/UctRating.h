@@ -208,9 +208,9 @@ struct latent_factor_t {
 extern double uct_owner[OWNER_MAX];
 extern double uct_criticality[CRITICALITY_MAX];
 
-extern index_hash_t md3_index[HASH_MAX];
-extern index_hash_t md4_index[HASH_MAX];
-extern index_hash_t md5_index[HASH_MAX];
+extern pattern_index_t md3_index;
+extern pattern_index_t md4_index;
+extern pattern_index_t md5_index;
 
 extern char uct_params_path[1024];
 
@@ -225,8 +225,11 @@ void InitializeUctRating( void );
 //  戦術的特徴のレートの計算
 double CalculateLFRScore( const game_info_t *game, int pos, int pat_index[3], uct_features_t *uct_features );
 
+//  num手のレートをまとめて計算 (特徴の判定は済ませておく)
+void CalculateLFRScores( const game_info_t *game, const int num, const int pos[], const int index[][3], const uct_features_t *uct_features, double score[] );
+
 //  特徴の判定
-void UctCheckFeatures( const game_info_t *game, int color, uct_features_t *uct_features );
+void UctCheckFeatures( game_info_t *game, int color, uct_features_t *uct_features );
 
 //  2目の抜き後の判定
 void UctCheckRemove2Stones( const game_info_t *game, int color, uct_features_t *uct_features );
@@ -244,10 +247,10 @@ bool UctCheckSelfAtari( const game_info_t *game, int color, int pos, uct_feature
 void UctCheckCapture( const game_info_t *game, int color, int pos, uct_features_t *uct_features );
 
 //  アタリの判定
-void UctCheckAtari( const game_info_t *game, int color, int pos, uct_features_t *uct_features );
+void UctCheckAtari( game_info_t *game, int color, int pos, uct_features_t *uct_features );
 
 //  ウッテガエシの判定
-void UctCheckSnapBack( const game_info_t *game, int color, int pos, uct_features_t *uct_features );
+void UctCheckSnapBack( game_info_t *game, int color, int pos, uct_features_t *uct_features );
 
 //  ケイマのツケコシの判定
 void UctCheckKeimaTsukekoshi( const game_info_t *game, int color, int pos, uct_features_t *uct_features );
@@ -259,6 +262,6 @@ void UctCheckDoubleKeima( const game_info_t *game, int color, int pos, uct_featu
 void UctCheckKoConnection( const game_info_t *game, uct_features_t *uct_features );
 
 //  現局面の評価
-void AnalyzeUctRating( const game_info_t *game, int color, double rate[] );
+void AnalyzeUctRating( game_info_t *game, int color, double rate[] );
 
 #endif
@@ -10,16 +10,21 @@
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <mutex>
 #include <numeric>
 #include <thread>
 #include <random>
 #include <queue>
 
+#include "BatchControl.h"
 #include "DynamicKomi.h"
+#include "EvalStat.h"
+#include "Evaluator.h"
 #include "GoBoard.h"
 #include "Ladder.h"
 #include "Message.h"
+#include "PlayoutStat.h"
 #include "MoveCache.h"
 #include "PatternHash.h"
 #include "Point.h"
@@ -40,7 +45,6 @@
 #include <sys/time.h>
 #endif
 
-#include "CNTKLibrary.h"
 
 using namespace std;
 
@@ -54,26 +58,79 @@ typedef std::map<std::wstring, std::vector<float>*> Layer;
 
 struct value_eval_req {
   child_node_t *uct_child;
+  int index;                // uct_childを持つノード
+  unsigned long long hash;  // 要求時のindexのハッシュ値
+  double priority;          // 評価の優先度
   int color;
   int trans;
   std::vector<int> path;
   std::vector<float> data_basic;
   std::vector<float> data_features;
   std::vector<float> data_history;
+  eval_timestamp_t time;
+};
+
+// 対称形をまとめて評価したPolicyの和
+struct policy_ensemble_t {
+  int count;                // 評価済みの対称形の数
+  int total;                // 評価する対称形の数
+  std::vector<double> sum;  // 子ノード毎の評価値の和
 };
 
 struct policy_eval_req {
   int index;
+  unsigned long long hash;  // 要求時のindexのハッシュ値
+  double priority;          // 評価の優先度
   int depth;
   int color;
   int trans;
   std::vector<float> data_basic;
   std::vector<float> data_features;
   std::vector<float> data_history;
+  // 同じ局面のValue (2つの出力を持つモデルで同時に評価する, 入力は持たない)
+  std::shared_ptr<value_eval_req> value;
+  // 全ての対称形を評価する時の集計先
+  std::shared_ptr<policy_ensemble_t> ensemble;
+  eval_timestamp_t time;
+};
+
+// 優先度の高い評価要求から取り出すキュー
+template <typename T>
+class EvalQueue {
+public:
+  void push( const std::shared_ptr<T>& req ) {
+    heap.push_back(req);
+    std::push_heap(heap.begin(), heap.end(), Compare);
+  }
+
+  std::shared_ptr<T> pop() {
+    std::pop_heap(heap.begin(), heap.end(), Compare);
+    std::shared_ptr<T> req = heap.back();
+    heap.pop_back();
+    return req;
+  }
+
+  size_t size() const { return heap.size(); }
+  bool empty() const { return heap.empty(); }
+
+  // predを満たす要求を取り除く
+  template <typename Pred>
+  void remove_if( Pred pred ) {
+    heap.erase(std::remove_if(heap.begin(), heap.end(), pred), heap.end());
+    std::make_heap(heap.begin(), heap.end(), Compare);
+  }
+
+private:
+  static bool Compare( const std::shared_ptr<T>& a, const std::shared_ptr<T>& b ) {
+    return a->priority < b->priority;
+  }
+
+  std::vector<std::shared_ptr<T>> heap;
 };
 
 void ReadWeights();
 void EvalNode();
+static void BackupValue( const value_eval_req& req, float win );
 //void EvalUctNode(std::vector<int>& indices, std::vector<int>& color, std::vector<int>& trans, std::vector<float>& data, std::vector<int>& path);
 
 ////////////////
@@ -95,6 +152,7 @@ static int pw[PURE_BOARD_MAX + 1];
 // ノード展開の閾値
 static int expand_threshold = EXPAND_THRESHOLD_19;
 
+// Valueの評価待ちが溜まっているときに評価するノードの探索回数の閾値
 static double value_evaluation_threshold = 0;
 
 // ノードを展開しない
@@ -198,13 +256,28 @@ static bool early_pass = true;
 
 static bool use_nn = true;
 static int device_id = -2;
-static std::queue<std::shared_ptr<policy_eval_req>> eval_policy_queue;
-static std::queue<std::shared_ptr<value_eval_req>> eval_value_queue;
+static EvalQueue<policy_eval_req> eval_policy_queue;
+static EvalQueue<value_eval_req> eval_value_queue;
 static int eval_count_policy, eval_count_value;
 static double owner_nn[BOARD_MAX];
 
-static CNTK::FunctionPtr nn_policy;
-static CNTK::FunctionPtr nn_value;
+static NN_BACKEND nn_backend = DEFAULT_NN_BACKEND;
+// 2つの出力を持つモデルではnn_policyとnn_valueは同じ評価器
+static std::shared_ptr<Evaluator> nn_policy;
+static std::shared_ptr<Evaluator> nn_value;
+static bool nn_dual = false;
+
+// 全ての対称形を評価するノードの深さ (ルートが1, 0なら使わない)
+static int symmetry_depth = 1;
+// 乱数で対称形を選ぶか (falseなら常に元の向き)
+static bool random_symmetry = true;
+
+// 評価時間から決めるバッチサイズ
+static BatchControl policy_batch("policy", policy_batch_size);
+static BatchControl value_batch("value", value_batch_size);
+
+// 評価の待ち時間と評価時間の計測
+static EvalStat eval_stat;
 
 //template<double>
 double atomic_fetch_add(std::atomic<double> *obj, double arg) {
@@ -214,14 +287,54 @@ double atomic_fetch_add(std::atomic<double> *obj, double arg) {
   return expected;
 }
 
+// 要求した時のノードが残っているか
+static bool
+IsLiveNode( int index, unsigned long long hash )
+{
+  return node_hash[index].flag && node_hash[index].hash == hash;
+}
+
+// 評価の優先度
+// 親ノードの探索回数と事前確率から見込まれる訪問回数を深さで割り引く
+static double
+EvalPriority( int parent, int child, int depth )
+{
+  const uct_node_t *node = &uct_node[parent];
+  const double prior = node->evaled ? node->child[child].nnrate : 1.0 / node->child_num;
+
+  return (node->move_count + 1) * prior / depth;
+}
+
+// Valueの逆伝播の経路を新しいルートからにする
+// 捨てられたノードの要求ならfalseを返す
+static bool
+TrimValuePath( value_eval_req& req, int root )
+{
+  if (!IsLiveNode(req.index, req.hash))
+    return false;
+  auto it = find(req.path.begin(), req.path.end(), root);
+  if (it == req.path.end())
+    return false;
+  req.path.erase(req.path.begin(), it);
+  return true;
+}
+
+// 探索木の再利用で捨てられたノードの評価要求を取り除く
+// 残ったノードのValueの評価は新しいルートから逆伝播させる
 static void
-ClearEvalQueue()
+PruneEvalQueue( int root )
 {
   mutex_queue.lock();
-  queue<shared_ptr<value_eval_req>> empty_value;
-  eval_value_queue.swap(empty_value);
-  queue<shared_ptr<policy_eval_req>> empty_policy;
-  eval_policy_queue.swap(empty_policy);
+  eval_policy_queue.remove_if([root](const shared_ptr<policy_eval_req>& req) {
+    if (!IsLiveNode(req->index, req->hash))
+      return true;
+    if (req->value && !TrimValuePath(*req->value, root))
+      req->value.reset();
+    return false;
+  });
+  eval_value_queue.remove_if([root](const shared_ptr<value_eval_req>& req) {
+    return !TrimValuePath(*req, root);
+  });
   mutex_queue.unlock();
 }
 
@@ -272,7 +385,7 @@ static void ParallelUctSearch( thread_arg_t *arg );
 static void ParallelUctSearchPondering( thread_arg_t *arg );
 
 // ノードのレーティング
-static void RatingNode( game_info_t *game, int color, int index, int depth );
+static void RatingNode( game_info_t *game, int color, int index, int depth, double priority, const std::shared_ptr<value_eval_req>& value );
 
 static int RateComp( const void *a, const void *b );
 
@@ -400,6 +513,9 @@ SetParameter( void )
   } else {
     expand_threshold = EXPAND_THRESHOLD_19;
   }
+
+  policy_batch.SetMaxBatchSize(policy_batch_size);
+  value_batch.SetMaxBatchSize(value_batch_size);
 }
 
 ////////////////////
@@ -417,12 +533,57 @@ SetDeviceId(const int id)
   device_id = id;
 }
 
+void
+SetNNBackend( const NN_BACKEND backend )
+{
+  nn_backend = backend;
+}
+
 void
 SetNoExpand(bool flag)
 {
   no_expand = flag;
 }
 
+//////////////////////////
+//  対称形の評価の設定  //
+//////////////////////////
+void
+SetSymmetryDepth( const int depth )
+{
+  symmetry_depth = depth;
+}
+
+void
+SetRandomSymmetry( const bool flag )
+{
+  random_symmetry = flag;
+}
+
+
+//////////////////////////////
+//  評価する対称形を選ぶ    //
+//////////////////////////////
+//  rand()は共有の状態を持つので, スレッド毎の状態と
+//  局面のハッシュ値から決める
+static int
+SampleSymmetry( const unsigned long long hash )
+{
+  static thread_local unsigned long long state = 0;
+
+  if (!random_symmetry) {
+    return 0;
+  }
+
+  // splitmix64
+  unsigned long long z = (state += 0x9e3779b97f4a7c15ULL) ^ hash;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+
+  return (int)(z >> 61);
+}
+
 //////////////////////////////////////
 //  time_settingsコマンドによる設定  //
 //////////////////////////////////////
@@ -610,14 +771,16 @@ UctSearchGenmove( game_info_t *game, int color )
     ClearUctHash();
   }
 
-  ClearEvalQueue();
-
   eval_count_policy = 0;
   eval_count_value = 0;
 
   // 探索開始時刻の記録
   begin_time = ray_clock::now();
 
+  // 探索時間に合わせて評価の遅延の目標を決める
+  policy_batch.SetLatencyTarget(BatchLatencyTarget(time_limit));
+  value_batch.SetLatencyTarget(BatchLatencyTarget(time_limit));
+
   // UCTの初期化
   current_root = ExpandRoot(game, color);
 
@@ -765,12 +928,11 @@ UctSearchGenmove( game_info_t *game, int color )
   // 次の探索でのプレイアウト回数の算出
   CalculateNextPlayouts(game, color, best_wp, finish_time);
 
-  ClearEvalQueue();
-
   if (use_nn && GetDebugMessageMode()) {
     cerr << "Eval NN Policy     :  " << setw(7) << (eval_count_policy + eval_policy_queue.size()) << endl;
     cerr << "Eval NN Value      :  " << setw(7) << (eval_count_value + eval_value_queue.size()) << endl;
     cerr << "Eval NN            :  " << setw(7) << eval_count_policy << "/" << eval_count_value << "/" << value_evaluation_threshold << endl;
+    PrintEvalBatchStat(cerr);
     cerr << "Count Captured     :  " << setw(7) << count << endl;
     cerr << "Score              :  " << setw(7) << score << endl;
     PrintMoveStat(cerr, game, uct_node, current_root);
@@ -1006,6 +1168,9 @@ ExpandRoot( game_info_t *game, int color )
     std::sort(indexes.begin(), indexes.end());
     ClearNotDescendentNodes(indexes);
 
+    // 残ったノードの評価要求だけを残す
+    PruneEvalQueue(index);
+
     // 直前と2手前の着手を更新
     uct_node[index].previous_move1 = pm1;
     uct_node[index].previous_move2 = pm2;
@@ -1035,7 +1200,7 @@ ExpandRoot( game_info_t *game, int color )
     uct_node[index].width = 1;
 
     // 候補手のレーティング
-    RatingNode(game, color, index, path.size());
+    RatingNode(game, color, index, path.size(), numeric_limits<double>::max(), nullptr);
 
     PrintReuseCount(uct_node[index].move_count);
 
@@ -1044,6 +1209,9 @@ ExpandRoot( game_info_t *game, int color )
     // 全ノードのクリア
     ClearUctHash();
 
+    // 評価要求も全て捨てる
+    PruneEvalQueue(-1);
+
     // 空のインデックスを探す
     index = SearchEmptyIndex(hash, color, moves);
 
@@ -1095,7 +1263,7 @@ ExpandRoot( game_info_t *game, int color )
     uct_node[index].child_num = child_num;
 
     // 候補手のレーティング
-    RatingNode(game, color, index, path.size());
+    RatingNode(game, color, index, path.size(), numeric_limits<double>::max(), nullptr);
 
     // セキの確認
     CheckSeki(game, uct_node[index].seki);
@@ -1173,8 +1341,31 @@ ExpandNode( game_info_t *game, int color, int current, const std::vector<int>& p
   // 子ノードの個数を設定
   uct_node[index].child_num = child_num;
 
+  // 親ノードでの着手から評価の優先度を求める
+  double priority = 0;
+  shared_ptr<value_eval_req> value;
+  for (int i = 0; i < uct_node[current].child_num; i++) {
+    child_node_t *edge = &uct_node[current].child[i];
+    if (edge->pos == pm1) {
+      priority = EvalPriority(current, i, path.size() + 1);
+      // Valueがまだ要求されていなければ, Policyと一緒に評価する
+      bool expected = false;
+      if (use_nn && nn_dual
+	  && atomic_compare_exchange_strong(&edge->eval_value, &expected, true)) {
+	value = make_shared<value_eval_req>();
+	value->uct_child = edge;
+	value->index = current;
+	value->hash = node_hash[current].hash;
+	value->priority = priority;
+	value->color = color;
+	value->path = path;
+      }
+      break;
+    }
+  }
+
   // 候補手のレーティング
-  RatingNode(game, color, index, path.size() + 1);
+  RatingNode(game, color, index, path.size() + 1, priority, value);
 
   // セキの確認
   CheckSeki(game, uct_node[index].seki);
@@ -1213,13 +1404,17 @@ ExpandNode( game_info_t *game, int color, int current, const std::vector<int>& p
 //  (Progressive Wideningのために)  //
 //////////////////////////////////////
 static void
-RatingNode( game_info_t *game, int color, int index, int depth )
+RatingNode( game_info_t *game, int color, int index, int depth, double priority, const shared_ptr<value_eval_req>& value )
 {
   const int child_num = uct_node[index].child_num;
   const int moves = game->moves;
   int pos, max_index;
   int pat_index[3] = {0};
-  double score = 0.0, max_score, dynamic_parameter;
+  double max_score, dynamic_parameter;
+  // パターンのレートをまとめて計算する着手
+  int rating_num = 0;
+  int rating_child[UCT_CHILD_MAX], rating_pos[UCT_CHILD_MAX], rating_index[UCT_CHILD_MAX][3];
+  double rating_score[UCT_CHILD_MAX];
   bool self_atari_flag;
   pattern_hash_t hash_pat;
   child_node_t *uct_child = uct_node[index].child;
@@ -1253,17 +1448,39 @@ RatingNode( game_info_t *game, int color, int index, int depth )
     double rate[PURE_BOARD_MAX];
     AnalyzePoRating(game, color, rate);
 
-    auto req = make_shared<policy_eval_req>();
-    req->color = color;
-    req->depth = depth;
-    req->index = index;
-    req->trans = rand() / (RAND_MAX / 8 + 1);
-    //req.path.swap(path);
-    WritePlanes(req->data_basic, req->data_features, req->data_history, nullptr,
-      game, root, color, req->trans);
+    // 浅いノードは8つの対称形を全て評価して平均する
+    const int symmetries = depth <= symmetry_depth ? 8 : 1;
+    std::vector<shared_ptr<policy_eval_req>> reqs(symmetries);
+    shared_ptr<policy_ensemble_t> ensemble;
+    if (symmetries > 1) {
+      ensemble = make_shared<policy_ensemble_t>();
+      ensemble->count = 0;
+      ensemble->total = symmetries;
+    }
+    for (int i = 0; i < symmetries; i++) {
+      auto req = make_shared<policy_eval_req>();
+      req->color = color;
+      req->depth = depth;
+      req->index = index;
+      req->hash = node_hash[index].hash;
+      req->priority = priority;
+      // Valueはどれか1つで評価すればよい
+      if (i == 0) {
+        req->value = value;
+      }
+      req->ensemble = ensemble;
+      req->trans = symmetries > 1 ? i : SampleSymmetry(game->current_hash);
+      //req.path.swap(path);
+      WritePlanes(req->data_basic, req->data_features, req->data_history, nullptr,
+        game, root, color, req->trans);
+      reqs[i] = req;
+    }
 #if 1
     mutex_queue.lock();
-    eval_policy_queue.push(req);
+    for (auto& req : reqs) {
+      req->time.enqueue = ray_clock::now();
+      eval_policy_queue.push(req);
+    }
     mutex_queue.unlock();
     //push_back(u);
 #else
@@ -1296,42 +1513,40 @@ RatingNode( game_info_t *game, int color, int index, int depth )
     // 自己アタリが無意味だったらスコアを0.0にする
     // 逃げられないシチョウならスコアを-1.0にする
     if (!self_atari_flag) {
-      score = 0.0;
+      uct_child[i].rate = 0.0;
     } else if (uct_child[i].ladder) {
-      score = -1.0;
+      uct_child[i].rate = -1.0;
     } else {
-#if 1
       // MD3, MD4, MD5のパターンのハッシュ値を求める
       PatternHash(&game->pat[pos], &hash_pat);
       // MD3のパターンのインデックスを探す
-      pat_index[0] = SearchIndex(md3_index, hash_pat.list[MD_3]);
+      rating_index[rating_num][0] = SearchIndex(md3_index, hash_pat.list[MD_3]);
       // MD4のパターンのインデックスを探す
-      pat_index[1] = SearchIndex(md4_index, hash_pat.list[MD_4]);
+      rating_index[rating_num][1] = SearchIndex(md4_index, hash_pat.list[MD_4]);
       // MD5のパターンのインデックスを探す
-      pat_index[2] = SearchIndex(md5_index, hash_pat.list[MD_5 + MD_MAX]);
-
-      score = CalculateLFRScore(game, pos, pat_index, &uct_features);
-#else
-      pos = uct_child[i].pos;
-      int x = X(pos) - OB_SIZE;
-      int y = Y(pos) - OB_SIZE;
-      int n = x + y * pure_board_size;
-      score = outputs[n] / sum;
-      if (score > 0)
-        uct_child[i].flag = true;
-#endif
+      rating_index[rating_num][2] = SearchIndex(md5_index, hash_pat.list[MD_5 + MD_MAX]);
+      rating_pos[rating_num] = pos;
+      rating_child[rating_num] = i;
+      rating_num++;
     }
+  }
 
-    // その手のγを記録
-    uct_child[i].rate = score;
+  // 特徴を全て判定してから, 残りの着手のγをまとめて求める
+  CalculateLFRScores(game, rating_num, rating_pos, rating_index, &uct_features, rating_score);
+  for (int i = 0; i < rating_num; i++) {
+    uct_child[rating_child[i]].rate = rating_score[i];
+  }
+
+  for (int i = 1; i < child_num; i++) {
+    pos = uct_child[i].pos;
 
     // 現在見ている箇所のOwnerとCriticalityの補正値を求める
     dynamic_parameter = uct_owner[owner_index[pos]] + uct_criticality[criticality_index[pos]];
 
     // 最もγが大きい着手を記録する
-    if (score + dynamic_parameter > max_score) {
+    if (uct_child[i].rate + dynamic_parameter > max_score) {
       max_index = i;
-      max_score = score + dynamic_parameter;
+      max_score = uct_child[i].rate + dynamic_parameter;
     }
   }
 
@@ -1439,11 +1654,16 @@ WaitForEvaluationQueue(bool ponderingmode)
 {
   static std::atomic<int> queue_full;
 
-  value_evaluation_threshold = max(0.0, value_evaluation_threshold - 0.01);
+  const size_t policy_limit = policy_batch.BatchSize() * 3;
+  const size_t value_limit = value_batch.BatchSize() * 3;
 
   // Wait if dcnn queue is full
   mutex_queue.lock();
-  while (eval_value_queue.size() > value_batch_size * 3 || eval_policy_queue.size() > policy_batch_size * 3) {
+  // 評価待ちの量に応じて, 探索回数の少ないノードのValueの評価を控える
+  value_evaluation_threshold = 0.5 * min(1.0, (double)eval_value_queue.size() / value_limit);
+  bool waited = false;
+  ray_clock::time_point wait_start;
+  while (eval_value_queue.size() > value_limit || eval_policy_queue.size() > policy_limit) {
     if (!running) break;
     if (ponderingmode) {
       if (pondering_stop) break;
@@ -1451,7 +1671,10 @@ WaitForEvaluationQueue(bool ponderingmode)
       if (GetSpendTime(begin_time) > time_limit) break;
     }
     std::atomic_fetch_add(&queue_full, 1);
-    value_evaluation_threshold = min(0.5, value_evaluation_threshold + 0.01);
+    if (!waited) {
+      waited = true;
+      wait_start = ray_clock::now();
+    }
     mutex_queue.unlock();
     this_thread::sleep_for(chrono::milliseconds(10));
     if (queue_full % 1000 == 0)
@@ -1459,6 +1682,10 @@ WaitForEvaluationQueue(bool ponderingmode)
     mutex_queue.lock();
   }
   mutex_queue.unlock();
+
+  if (waited) {
+    eval_stat.RecordSearchWait(chrono::duration<double>(ray_clock::now() - wait_start).count());
+  }
 }
 
 /////////////////////////////////
@@ -1477,6 +1704,10 @@ ParallelUctSearch( thread_arg_t *arg )
   int interval = CRITICALITY_INTERVAL;
 
   game = AllocateGame();
+  CopyGame(game, targ->game);
+
+  // プレイアウトの計測値の書き込み先
+  BindPlayoutStat(targ->thread_id);
 
   // スレッドIDが0のスレッドだけ別の処理をする
   // 探索回数が閾値を超える, または探索が打ち切られたらループを抜ける
@@ -1486,8 +1717,8 @@ ParallelUctSearch( thread_arg_t *arg )
       WaitForEvaluationQueue(false);
       // 探索回数を1回増やす
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
+      // 前回のプレイアウトで変わった所だけ盤面を戻す
+      RestoreGame(game, targ->game);
       // 1回プレイアウトする
       std::vector<int> path;
       UctSearch(game, color, mt[targ->thread_id].get(), lgr, lgr_ctx[targ->thread_id], current_root, &winner, path);
@@ -1511,8 +1742,8 @@ ParallelUctSearch( thread_arg_t *arg )
       WaitForEvaluationQueue(false);
       // 探索回数を1回増やす
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
+      // 前回のプレイアウトで変わった所だけ盤面を戻す
+      RestoreGame(game, targ->game);
       // 1回プレイアウトする
 	  std::vector<int> path;
       UctSearch(game, color, mt[targ->thread_id].get(), lgr, lgr_ctx[targ->thread_id], current_root, &winner, path);
@@ -1546,6 +1777,10 @@ ParallelUctSearchPondering( thread_arg_t *arg )
   int interval = CRITICALITY_INTERVAL;
 
   game = AllocateGame();
+  CopyGame(game, targ->game);
+
+  // プレイアウトの計測値の書き込み先
+  BindPlayoutStat(targ->thread_id);
 
   // スレッドIDが0のスレッドだけ別の処理をする
   // 探索回数が閾値を超える, または探索が打ち切られたらループを抜ける
@@ -1555,8 +1790,8 @@ ParallelUctSearchPondering( thread_arg_t *arg )
       WaitForEvaluationQueue(true);
       // 探索回数を1回増やす
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
+      // 前回のプレイアウトで変わった所だけ盤面を戻す
+      RestoreGame(game, targ->game);
       // 1回プレイアウトする
       std::vector<int> path;
       UctSearch(game, color, mt[targ->thread_id].get(), lgr, lgr_ctx[targ->thread_id], current_root, &winner, path);
@@ -1576,8 +1811,8 @@ ParallelUctSearchPondering( thread_arg_t *arg )
       WaitForEvaluationQueue(true);
       // 探索回数を1回増やす
       atomic_fetch_add(&po_info.count, 1);
-      // 盤面のコピー
-      CopyGame(game, targ->game);
+      // 前回のプレイアウトで変わった所だけ盤面を戻す
+      RestoreGame(game, targ->game);
       // 1回プレイアウトする
       std::vector<int> path;
       UctSearch(game, color, mt[targ->thread_id].get(), lgr, lgr_ctx[targ->thread_id], current_root, &winner, path);
@@ -1659,19 +1894,23 @@ UctSearch(game_info_t *game, int color, mt19937_64 *mt, LGR& lgrf, LGRContext& l
       AnalyzePoRating(game, color, rate);
       auto req = make_shared<value_eval_req>();
       req->uct_child = uct_child + next_index;
+      req->index = current;
+      req->hash = node_hash[current].hash;
+      req->priority = EvalPriority(current, next_index, path.size());
       req->color = color;
       //req->index = index;
-      req->trans = rand() / (RAND_MAX / 8 + 1);
+      req->trans = SampleSymmetry(game->current_hash);
       req->path.swap(path);
       WritePlanes(req->data_basic, req->data_features, req->data_history, nullptr,
         game, root, color, req->trans);
       mutex_queue.lock();
+      req->time.enqueue = ray_clock::now();
       eval_value_queue.push(req);
       mutex_queue.unlock();
     }
 
     // 終局まで対局のシミュレーション
-    Simulation(game, color, mt, lgr, lgrctx);
+    Simulation(game, color, mt, lgr, lgrctx, true);
 
     // コミを含めない盤面のスコアを求める
     score = (double)CalculateScore(game);
@@ -2472,154 +2711,61 @@ CorrectDescendentNodes(vector<int> &indexes, int index)
 
 extern char uct_params_path[1024];
 
-static CNTK::DeviceDescriptor
-GetDevice()
-{
-  if (device_id == -1)
-    return CNTK::DeviceDescriptor::CPUDevice();
-  if (device_id == -2)
-    return CNTK::DeviceDescriptor::UseDefaultDevice();
-  return CNTK::DeviceDescriptor::GPUDevice(device_id);
-}
-
 void
 ReadWeights()
 {
-  wchar_t name[1024];
-  mbstate_t ps;
-  memset(&ps, 0, sizeof(ps));
-  const char * src = uct_params_path;
-  mbsrtowcs(name, &src, 1024, &ps);
-  wstring path = name;
-
-  cerr << "Init CNTK" << endl;
-
-  auto device = GetDevice();
-
-  wstring policy_name = path;
-  policy_name += L"/model2.bin";
-  nn_policy = CNTK::Function::Load(policy_name, device);
-
-  wstring value_name = path;
-  value_name += L"/model3.bin";
-  nn_value = CNTK::Function::Load(value_name, device);
-
-  if (!nn_policy || !nn_value)
-  {
-    cerr << "Get EvalModel failed\n";
-    abort();
+  cerr << (nn_backend == NN_BACKEND_CNTK ? "Init CNTK" : "Init CPU evaluator") << endl;
+
+  // 2つの出力を持つモデルがあればそれを使う
+  nn_dual = ExistsModel(nn_backend, NN_MODEL_DUAL, uct_params_path);
+  if (nn_dual) {
+    nn_policy = CreateEvaluator(nn_backend, NN_MODEL_DUAL, uct_params_path, device_id);
+    nn_value = nn_policy;
+    if (nn_policy->OutputSize(NN_OUTPUT_POLICY) == 0 || nn_policy->OutputSize(NN_OUTPUT_VALUE) == 0) {
+      cerr << "Dual model must have both policy and value outputs" << endl;
+      exit(1);
+    }
+  } else {
+    nn_policy = CreateEvaluator(nn_backend, NN_MODEL_POLICY, uct_params_path, device_id);
+    nn_value = CreateEvaluator(nn_backend, NN_MODEL_VALUE, uct_params_path, device_id);
   }
 
-#if 0
-  wcerr << L"***POLICY" << endl;
-  for (auto var : nn_policy->Inputs()) {
-    wcerr << var.AsString() << endl;
-  }
-  for (auto var : nn_policy->Outputs()) {
-    wcerr << var.AsString() << endl;
-  }
-  wcerr << L"***VALUE" << endl;
-  for (auto var : nn_value->Inputs()) {
-    wcerr << var.AsString() << endl;
-  }
-  for (auto var : nn_value->Outputs()) {
-    wcerr << var.AsString() << endl;
-  }
-#endif
+  nn_policy->Reserve(policy_batch.GetMaxBatchSize());
+  nn_value->Reserve(value_batch.GetMaxBatchSize());
 
   cerr << "ok" << endl;
 }
 
 
-bool
-GetVariableByName(vector<CNTK::Variable> variableLists, wstring varName, CNTK::Variable& var)
-{
-  for (vector<CNTK::Variable>::iterator it = variableLists.begin(); it != variableLists.end(); ++it)
-  {
-    if (it->Name().compare(varName) == 0)
-    {
-      var = *it;
-      return true;
-    }
-  }
-  return false;
-}
-
-inline bool
-GetInputVariableByName(CNTK::FunctionPtr evalFunc, wstring varName, CNTK::Variable& var)
-{
-  return GetVariableByName(evalFunc->Arguments(), varName, var);
-}
-
-inline bool
-GetOutputVaraiableByName(CNTK::FunctionPtr evalFunc, wstring varName, CNTK::Variable& var)
-{
-  return GetVariableByName(evalFunc->Outputs(), varName, var);
-}
-
 void
-EvalPolicy(
-  const std::vector<std::shared_ptr<policy_eval_req>>& requests,
-  std::vector<float>& data_basic, std::vector<float>& data_features, std::vector<float>& data_history,
-  std::vector<float>& data_color, std::vector<float>& data_komi)
+EvalPolicy( const std::vector<std::shared_ptr<policy_eval_req>>& requests )
 {
   if (requests.size() == 0)
     return;
 
-  auto device = GetDevice();
-
-  CNTK::Variable var_basic, var_features, var_history, var_color, var_komi;
-  GetInputVariableByName(nn_policy, L"basic", var_basic);
-  GetInputVariableByName(nn_policy, L"features", var_features);
-  GetInputVariableByName(nn_policy, L"history", var_history);
-  GetInputVariableByName(nn_policy, L"color", var_color);
-  GetInputVariableByName(nn_policy, L"komi", var_komi);
-
-  CNTK::Variable var_ol;
-  GetOutputVaraiableByName(nn_policy, L"ol", var_ol);
-
-  size_t num_req = requests.size();
-
-  CNTK::NDShape shape_basic = var_basic.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_basic = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_basic, data_basic, true));
-  CNTK::NDShape shape_features = var_features.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_features = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_features, data_features, true));
-  CNTK::NDShape shape_history = var_history.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_history = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_history, data_history, true));
-  CNTK::NDShape shape_color = var_color.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_color = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_color, data_color, true));
-  //CNTK::NDShape shape_komi = var_komi.Shape().AppendShape({ 1, num_req });
-  //CNTK::ValuePtr value_komi = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_komi, data_komi, true));
-
-  CNTK::ValuePtr value_ol;
-
-  std::unordered_map<CNTK::Variable, CNTK::ValuePtr> inputs = {
-    { var_basic, value_basic },
-    { var_features, value_features },
-    { var_history, value_history },
-    //{ var_color, value_color },
-    //{ var_komi, value_komi },
-  };
-  std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = { { var_ol, value_ol } };
-
-  try {
-    nn_policy->Forward(inputs, outputs, device);
-  } catch (const std::exception& err) {
-    fprintf(stderr, "Evaluation failed. EXCEPTION occurred: %s\n", err.what());
-    abort();
-  } catch (...) {
-    fprintf(stderr, "Evaluation failed. Unknown ERROR occurred.\n");
-    abort();
-  }
-
-  value_ol = outputs[var_ol];
-  CNTK::NDShape shape_ol = var_ol.Shape().AppendShape({ 1, num_req });
-  vector<float> moves(shape_ol.TotalSize());
-  CNTK::NDArrayViewPtr cpu_moves = CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_ol, moves, false);
-  cpu_moves->CopyFrom(*value_ol->Data());
-
-  if (moves.size() != pure_board_max * num_req) {
-    cerr << "Eval move error " << moves.size() << endl;
+  const int num_req = requests.size();
+  const auto batch_start = ray_clock::now();
+
+  nn_policy->Reserve(num_req);
+  for (int j = 0; j < num_req; j++) {
+    const auto& req = requests[j];
+    nn_policy->SetInput(NN_BASIC, j, req->data_basic);
+    nn_policy->SetInput(NN_FEATURES, j, req->data_features);
+    nn_policy->SetInput(NN_HISTORY, j, req->data_history);
+    // Policyだけのモデルでは使われない
+    nn_policy->SetInput(NN_COLOR, j, (float)(req->color - 1));
+    nn_policy->SetInput(NN_KOMI, j, (float)komi[0]);
+  }
+
+  auto start = ray_clock::now();
+  nn_policy->Forward(num_req);
+  const auto forward_done = ray_clock::now();
+  policy_batch.Record(num_req, chrono::duration<double>(forward_done - start).count());
+  const long long batch = eval_stat.RecordBatch(EVAL_POLICY, num_req, start, forward_done);
+
+  const float *moves = nn_policy->Output(NN_OUTPUT_POLICY);
+  if (nn_policy->OutputSize(NN_OUTPUT_POLICY) != (size_t)pure_board_max) {
+    cerr << "Eval move error " << nn_policy->OutputSize(NN_OUTPUT_POLICY) * num_req << endl;
     return;
   }
 
@@ -2633,6 +2779,10 @@ EvalPolicy(
     LOCK_NODE(index);
 
     int depth = req->depth;
+    policy_ensemble_t *ensemble = req->ensemble.get();
+    if (ensemble != nullptr && ensemble->sum.empty()) {
+      ensemble->sum.resize(child_num, 0.0);
+    }
 #if 0
     if (index == current_root) {
       for (int i = 0; i < pure_board_max; i++) {
@@ -2651,6 +2801,10 @@ EvalPolicy(
       int n = x + y * pure_board_size;
       double score = moves[n + ofs];
       //if (depth == 1) cerr << "RAW POLICY " << uct_child[i].pos << " " << req->trans << " " << FormatMove(pos) << " " << x << "," << y << " " << ofs << " -> " << score << endl;
+      if (ensemble != nullptr) {
+        ensemble->sum[i] += score;
+        score = ensemble->sum[i] / (ensemble->count + 1);
+      }
       if (uct_child[i].ladder) {
         score -= 4; // ~= 1.83%
       }
@@ -2658,121 +2812,110 @@ EvalPolicy(
       uct_child[i].nnrate0 = score;
     }
 
+    // 全ての対称形が揃うまでは途中までの平均を使う
+    if (ensemble != nullptr) {
+      ensemble->count++;
+    }
+
     UpdatePolicyRate(index);
     uct_node[index].evaled = true;
 
     UNLOCK_NODE(index);
+
+    // 一緒に要求されたValue
+    if (nn_dual && req->value) {
+      BackupValue(*req->value, nn_policy->Output(NN_OUTPUT_VALUE)[j]);
+      eval_count_value++;
+    }
+
+    req->time.batch_start = batch_start;
+    req->time.forward_done = forward_done;
+    req->time.backup_done = ray_clock::now();
+    eval_stat.RecordRequest(EVAL_POLICY, batch, num_req, req->time);
   }
   eval_count_policy += requests.size();
 }
 
 
+//////////////////////////////
+//  Valueの評価の逆伝播     //
+//////////////////////////////
+static void
+BackupValue( const value_eval_req& req, float win )
+{
+  double p = ((double)win + 1) / 2;
+  if (p < 0)
+    p = 0;
+  if (p > 1)
+    p = 1;
+  //cerr << "#" << index << "  " << sum << endl;
+
+  double value = 1 - p;// color[j] == S_BLACK ? p : 1 - p;
+
+  req.uct_child->value = value;
+  for (int i = req.path.size() - 1; i >= 0; i--) {
+    int current = req.path[i];
+    if (current < 0)
+      break;
+
+    atomic_fetch_add(&uct_node[current].value_move_count, 1);
+    atomic_fetch_add(&uct_node[current].value_win, value);
+    value = 1 - value;
+  }
+}
+
+
 void
-EvalValue(
-  const std::vector<std::shared_ptr<value_eval_req>>& requests,
-  std::vector<float>& data_basic, std::vector<float>& data_features, std::vector<float>& data_history,
-  std::vector<float>& data_color, std::vector<float>& data_komi, std::vector<float>& data_safety)
+EvalValue( const std::vector<std::shared_ptr<value_eval_req>>& requests )
 {
   if (requests.size() == 0)
     return;
 
-  auto device = GetDevice();
-
-  CNTK::Variable var_basic, var_features, var_history, var_color, var_komi, var_safety;
-  GetInputVariableByName(nn_value, L"basic", var_basic);
-  GetInputVariableByName(nn_value, L"features", var_features);
-  GetInputVariableByName(nn_value, L"history", var_history);
-  GetInputVariableByName(nn_value, L"color", var_color);
-  GetInputVariableByName(nn_value, L"komi", var_komi);
-  GetInputVariableByName(nn_value, L"safety", var_safety);
-
-  CNTK::Variable var_p;
-  GetOutputVaraiableByName(nn_value, L"p", var_p);
-
-  size_t num_req = requests.size();
-
-  CNTK::NDShape shape_basic = var_basic.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_basic = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_basic, data_basic, true));
-  CNTK::NDShape shape_features = var_features.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_features = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_features, data_features, true));
-  CNTK::NDShape shape_history = var_history.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_history = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_history, data_history, true));
-  CNTK::NDShape shape_color = var_color.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_color = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_color, data_color, true));
-  CNTK::NDShape shape_komi = var_komi.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_komi = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_komi, data_komi, true));
-  CNTK::NDShape shape_safety = var_safety.Shape().AppendShape({ 1, num_req });
-  CNTK::ValuePtr value_safety = CNTK::MakeSharedObject<CNTK::Value>(CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_safety, data_safety, true));
-
-  CNTK::ValuePtr value_p;
-
-  std::unordered_map<CNTK::Variable, CNTK::ValuePtr> inputs = {
-    { var_basic, value_basic },
-    { var_features, value_features },
-    { var_history, value_history },
-    { var_color, value_color },
-    { var_komi, value_komi },
-    { var_safety, value_safety },
-  };
-  std::unordered_map<CNTK::Variable, CNTK::ValuePtr> outputs = { { var_p, value_p } };
-
-  try {
-    nn_value->Forward(inputs, outputs, device);
-  } catch (const std::exception& err) {
-    fprintf(stderr, "Evaluation failed. EXCEPTION occurred: %s\n", err.what());
-    abort();
-  } catch (...) {
-    fprintf(stderr, "Evaluation failed. Unknown ERROR occurred.\n");
-    abort();
-  }
-
-  value_p = outputs[var_p];
-  CNTK::NDShape shape_p = var_p.Shape().AppendShape({ 1, num_req });
-  vector<float> win(shape_p.TotalSize());
-  CNTK::NDArrayViewPtr cpu_p = CNTK::MakeSharedObject<CNTK::NDArrayView>(shape_p, win, false);
-  cpu_p->CopyFrom(*value_p->Data());
-
-  if (win.size() != requests.size()) {
-    cerr << "Eval win error " << win.size() << endl;
+  const int num_req = requests.size();
+  const auto batch_start = ray_clock::now();
+
+  // safetyは常に0なので書き込まない
+  nn_value->Reserve(num_req);
+  for (int j = 0; j < num_req; j++) {
+    const auto& req = requests[j];
+    nn_value->SetInput(NN_BASIC, j, req->data_basic);
+    nn_value->SetInput(NN_FEATURES, j, req->data_features);
+    nn_value->SetInput(NN_HISTORY, j, req->data_history);
+    nn_value->SetInput(NN_COLOR, j, (float)(req->color - 1));
+    nn_value->SetInput(NN_KOMI, j, (float)komi[0]);
+  }
+
+  auto start = ray_clock::now();
+  nn_value->Forward(num_req);
+  const auto forward_done = ray_clock::now();
+  value_batch.Record(num_req, chrono::duration<double>(forward_done - start).count());
+  const long long batch = eval_stat.RecordBatch(EVAL_VALUE, num_req, start, forward_done);
+
+  const float *win = nn_value->Output(NN_OUTPUT_VALUE);
+  if (nn_value->OutputSize(NN_OUTPUT_VALUE) != 1) {
+    cerr << "Eval win error " << nn_value->OutputSize(NN_OUTPUT_VALUE) * num_req << endl;
     return;
   }
   //cerr << "Eval " << indices.size() << " " << path.size() << endl;
   for (int j = 0; j < requests.size(); j++) {
-    auto req = requests[j];
-
-    double p = ((double)win[j] + 1) / 2;
-    if (p < 0)
-      p = 0;
-    if (p > 1)
-      p = 1;
-    //cerr << "#" << index << "  " << sum << endl;
-
-    double value = 1 - p;// color[j] == S_BLACK ? p : 1 - p;
-
-    req->uct_child->value = value;
-    for (int i = req->path.size() - 1; i >= 0; i--) {
-      int current = req->path[i];
-      if (current < 0)
-	break;
-
-      atomic_fetch_add(&uct_node[current].value_move_count, 1);
-      atomic_fetch_add(&uct_node[current].value_win, value);
-      value = 1 - value;
-    }
+    const auto& req = requests[j];
+    BackupValue(*req, win[j]);
+
+    req->time.batch_start = batch_start;
+    req->time.forward_done = forward_done;
+    req->time.backup_done = ray_clock::now();
+    eval_stat.RecordRequest(EVAL_VALUE, batch, num_req, req->time);
   }
   eval_count_value += requests.size();
 }
 
 void EvalNode() {
-  std::vector<float> eval_input_data_basic;
-  std::vector<float> eval_input_data_features;
-  std::vector<float> eval_input_data_history;
-  std::vector<float> eval_input_data_color;
-  std::vector<float> eval_input_data_komi;
-  std::vector<float> eval_input_data_safety;
-
   int num_eval = 0;
   bool allow_skip = (!reuse_subtree && !ponder) || time_limit <= 1.0;
+  bool waiting = false;
+  ray_clock::time_point wait_start;
+
+  eval_stat.Start();
 
   while (true) {
     mutex_queue.lock();
@@ -2784,38 +2927,44 @@ void EvalNode() {
     }
 
     if (eval_policy_queue.empty() && eval_value_queue.empty()) {
-      value_evaluation_threshold = max(0.0, value_evaluation_threshold - 0.01);
       mutex_queue.unlock();
       this_thread::sleep_for(chrono::milliseconds(1));
       //cerr << "EMPTY QUEUE" << endl;
       continue;
     }
 
+    const size_t policy_size = policy_batch.BatchSize();
+    const size_t value_size = value_batch.BatchSize();
+
+    // どちらのバッチも埋まっていなければ, 待ち時間の間はバッチが埋まるのを待つ
+    if (running
+      && eval_policy_queue.size() < policy_size
+      && eval_value_queue.size() < value_size) {
+      if (!waiting) {
+        waiting = true;
+        wait_start = ray_clock::now();
+      }
+      double timeout = max(eval_policy_queue.empty() ? 0.0 : policy_batch.FlushTimeout(),
+                           eval_value_queue.empty() ? 0.0 : value_batch.FlushTimeout());
+      if (chrono::duration<double>(ray_clock::now() - wait_start).count() < timeout) {
+        mutex_queue.unlock();
+        this_thread::sleep_for(chrono::microseconds(100));
+        continue;
+      }
+    }
+    waiting = false;
+
     if (eval_policy_queue.size() == 0) {
     } else {
       std::vector<std::shared_ptr<policy_eval_req>> requests;
 
-      for (int i = 0; i < policy_batch_size && !eval_policy_queue.empty(); i++) {
-        auto req = eval_policy_queue.front();
-        requests.push_back(req);
-        eval_policy_queue.pop();
+      for (size_t i = 0; i < policy_size && !eval_policy_queue.empty(); i++) {
+        requests.push_back(eval_policy_queue.pop());
       }
       mutex_queue.unlock();
 
-      eval_input_data_basic.resize(0);
-      eval_input_data_features.resize(0);
-      eval_input_data_history.resize(0);
-      eval_input_data_color.resize(0);
-      eval_input_data_komi.resize(0);
-      for (auto& req : requests) {
-        std::copy(req->data_basic.begin(), req->data_basic.end(), std::back_inserter(eval_input_data_basic));
-        std::copy(req->data_features.begin(), req->data_features.end(), std::back_inserter(eval_input_data_features));
-        std::copy(req->data_history.begin(), req->data_history.end(), std::back_inserter(eval_input_data_history));
-        eval_input_data_color.push_back(req->color - 1);
-        eval_input_data_komi.push_back(komi[0]);
-      }
       num_eval += requests.size();
-      EvalPolicy(requests, eval_input_data_basic, eval_input_data_features, eval_input_data_history, eval_input_data_color, eval_input_data_komi);
+      EvalPolicy(requests);
       mutex_queue.lock();
     }
 
@@ -2824,28 +2973,27 @@ void EvalNode() {
     } else {
       std::vector<std::shared_ptr<value_eval_req>> requests;
 
-      for (int i = 0; i < value_batch_size && !eval_value_queue.empty(); i++) {
-        auto req = eval_value_queue.front();
-        requests.push_back(req);
-        eval_value_queue.pop();
+      for (size_t i = 0; i < value_size && !eval_value_queue.empty(); i++) {
+        requests.push_back(eval_value_queue.pop());
       }
       mutex_queue.unlock();
 
-      eval_input_data_basic.resize(0);
-      eval_input_data_features.resize(0);
-      eval_input_data_history.resize(0);
-      eval_input_data_color.resize(0);
-      eval_input_data_komi.resize(0);
-      for (auto& req : requests) {
-        std::copy(req->data_basic.begin(), req->data_basic.end(), std::back_inserter(eval_input_data_basic));
-        std::copy(req->data_features.begin(), req->data_features.end(), std::back_inserter(eval_input_data_features));
-        std::copy(req->data_history.begin(), req->data_history.end(), std::back_inserter(eval_input_data_history));
-        eval_input_data_color.push_back(req->color - 1);
-        eval_input_data_komi.push_back(komi[0]);
-      }
-      eval_input_data_safety.resize(requests.size() * pure_board_max * 8);
       num_eval += requests.size();
-      EvalValue(requests, eval_input_data_basic, eval_input_data_features, eval_input_data_history, eval_input_data_color, eval_input_data_komi, eval_input_data_safety);
+      EvalValue(requests);
     }
   }
+
+  eval_stat.Stop();
+}
+
+
+//////////////////////////////
+//  バッチサイズの状態の出力  //
+//////////////////////////////
+void
+PrintEvalBatchStat( std::ostream &out )
+{
+  policy_batch.Print(out);
+  value_batch.Print(out);
+  eval_stat.Print(out);
 }
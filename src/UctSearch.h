@@ -2,8 +2,10 @@
 #define _UCTSEARCH_H_
 
 #include <atomic>
+#include <ostream>
 #include <random>
 
+#include "Evaluator.h"
 #include "GoBoard.h"
 #include "ZobristHash.h"
 
@@ -238,4 +240,15 @@ void SetUseNN(bool flag);
 
 void SetDeviceId( const int id );
 
+void SetNNBackend( const NN_BACKEND backend );
+
+// 全ての対称形を評価するノードの深さ
+void SetSymmetryDepth( const int depth );
+
+// 乱数で対称形を選ぶかの設定
+void SetRandomSymmetry( const bool flag );
+
+// NN評価のバッチサイズの状態を出力
+void PrintEvalBatchStat( std::ostream &out );
+
 #endif
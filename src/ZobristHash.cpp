@@ -14,8 +14,8 @@ using namespace std;
 //  変数  //
 ////////////
 
-//  UCTのノード用のビット列 (局面の合流なし)
-unsigned long long move_bit[MAX_RECORDS][BOARD_MAX][HASH_KO + 1]; 
+//  UCTのノード用のビット列の鍵 (局面の合流なし)
+unsigned long long move_key;
 
 // 局面を表すためのビット列
 unsigned long long hash_bit[BOARD_MAX][HASH_KO + 1];
@@ -81,14 +81,7 @@ InitializeHash( void )
   std::random_device rnd;
   std::mt19937_64 mt(rnd());
 
-  for (int i = 0; i < MAX_RECORDS; i++) {
-    for (int j = 0; j < BOARD_MAX; j++) {
-      move_bit[i][j][HASH_PASS] = mt();
-      move_bit[i][j][HASH_BLACK] = mt();
-      move_bit[i][j][HASH_WHITE] = mt();
-      move_bit[i][j][HASH_KO] = mt();
-    }
-  }
+  move_key = mt();
     
   for (int i = 0; i < BOARD_MAX; i++) {  
     hash_bit[i][HASH_PASS]  = mt();
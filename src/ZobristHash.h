@@ -35,8 +35,8 @@ struct node_hash_t {
 //  変数  //
 ////////////
 
-//  UCTのノード用のビット列 (局面の合流なし)
-extern unsigned long long move_bit[MAX_RECORDS][BOARD_MAX][HASH_KO + 1];
+//  UCTのノード用のビット列の鍵 (局面の合流なし)
+extern unsigned long long move_key;
 
 //  局面を表現するためのビット列
 extern unsigned long long hash_bit[BOARD_MAX][HASH_KO + 1];
@@ -54,6 +54,19 @@ extern unsigned int uct_hash_size;
 //  関数  //
 ////////////
 
+//  UCTのノード用のビット列
+//  (手数, 座標, 色)を番号にしたsplitmix64の乱数で, 表を引かずに求める
+inline unsigned long long
+MoveBit( const int moves, const int pos, const int color )
+{
+  const unsigned long long index = ((unsigned long long)moves << 16) | ((unsigned long long)pos << 2) | (unsigned long long)color;
+  unsigned long long x = move_key + index * 0x9e3779b97f4a7c15ULL;
+
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
 //  ハッシュテーブルのサイズの設定
 void SetHashSize( const unsigned int new_size );
 